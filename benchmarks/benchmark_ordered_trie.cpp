@@ -0,0 +1,672 @@
+/**
+ * @file  benchmark_ordered_trie.cpp
+ * @brief Micro-benchmarks of ordered trie visits over
+ *        synthetic data.
+ *
+ * Usage: benchmark_ordered_trie [benchmark_name...]
+ * Runs all benchmarks when no name is given.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ */
+
+#include "ordered_trie.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h>
+#define BENCHMARK_HAS_RDTSC 1
+#endif
+
+using namespace ordered_trie;
+
+namespace
+{
+
+using Node = detail::Node<Void>;
+
+/*
+ * Random strings over a small alphabet, so that short
+ * prefixes have a very large number of completions.
+ */
+std::vector<std::pair<std::string, std::uint64_t>>
+make_random_suggestions (const size_t       size,
+			 const size_t       alphabet,
+			 const size_t       max_length,
+			 const std::uint64_t seed)
+{
+  std::mt19937_64 rng {seed};
+  std::uniform_int_distribution<size_t> length_dist {1, max_length};
+  std::uniform_int_distribution<size_t> char_dist {0, alphabet - 1};
+  std::uniform_int_distribution<std::uint64_t> rank_dist {0, 1u << 20};
+
+  std::vector<std::pair<std::string, std::uint64_t>> result;
+  result.reserve (size);
+
+  for (size_t j = 0; j < size; ++j)
+  {
+    std::string text (length_dist (rng), 'a');
+
+    for (auto &c : text)
+    {
+      c = static_cast<char> ('a' + char_dist (rng));
+    }
+
+    result.emplace_back (std::move (text), rank_dist (rng));
+  }
+
+  std::sort (result.begin (), result.end ());
+
+  result.erase (
+    std::unique (result.begin (), result.end (),
+		 [] (const auto &lhs, const auto &rhs)
+		 {
+		   return lhs.first == rhs.first;
+		 }),
+    result.end ());
+
+  return result;
+}
+
+template<typename F>
+double measure_seconds (F &&f)
+{
+  const auto start = std::chrono::steady_clock::now ();
+  f ();
+  const auto stop = std::chrono::steady_clock::now ();
+  return std::chrono::duration<double> (stop - start).count ();
+}
+
+/*
+ * Locus of the subtrie of completions of @p prefix
+ */
+detail::SiblingsIterator<Node>
+match (const Node &root, const std::string &prefix)
+{
+  auto first = prefix.begin ();
+  const auto locus =
+    detail::prefix_match (root, first, prefix.end ());
+
+  if (first != prefix.end ())
+  {
+    return detail::SiblingsIterator<Node> {};
+  }
+
+  return detail::SiblingsIterator<Node>
+  {
+    locus,
+    Node::skip (locus.data ())
+  };
+}
+
+/*
+ * Enumerate completions of short prefixes with both
+ * frontier implementations.
+ */
+template<template<typename> class Frontier>
+void run_frontier (const char                     *name,
+		   const Node                     &root,
+		   const std::vector<std::string> &prefixes)
+{
+  detail::OrderedLeavesIterator<Node, Frontier> visit;
+
+  for (const auto &prefix : prefixes)
+  {
+    size_t count = 0;
+    std::uint64_t checksum = 0;
+
+    const auto seconds = measure_seconds ([&]
+    {
+      visit.reset (match (root, prefix));
+
+      for (; visit; ++visit)
+      {
+	checksum += visit->rank ();
+	++count;
+      }
+    });
+
+    std::cout << "  " << name
+	      << " prefix=\"" << prefix << "\""
+	      << " completions=" << count
+	      << " ns/completion=" << (seconds * 1e9 / count)
+	      << " (checksum " << checksum << ")"
+	      << std::endl;
+  }
+}
+
+void benchmark_frontier ()
+{
+  const auto suggestions =
+    make_random_suggestions (2000000, 4, 16, 42);
+
+  const auto trie =
+    detail::make_serialised_ordered_trie (suggestions);
+
+  const auto root = detail::make_trie_root (trie.data ());
+  const std::vector<std::string> prefixes = {"", "a", "ab"};
+
+  std::cout << "frontier: " << suggestions.size ()
+	    << " suggestions, trie size " << trie.size ()
+	    << " bytes" << std::endl;
+
+  run_frontier<detail::BinaryHeapFrontier> ("binary_heap", root, prefixes);
+  run_frontier<detail::RadixHeapFrontier> ("radix_heap ", root, prefixes);
+}
+
+/*
+ * Size of synthetic data sets, overridable through the
+ * ORDERED_TRIE_BENCHMARK_SIZE environment variable.
+ */
+size_t data_set_size (const size_t default_size)
+{
+  const auto *size = std::getenv ("ORDERED_TRIE_BENCHMARK_SIZE");
+  return size ? std::stoul (size) : default_size;
+}
+
+std::uint64_t read_cycles ()
+{
+#ifdef BENCHMARK_HAS_RDTSC
+  return __rdtsc ();
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Serve top-k queries for random prefixes against a trie
+ * exceeding the last level cache, where expanding a node is
+ * usually a cache miss.
+ */
+template<typename Prefetch>
+void run_prefetch (const char                     *name,
+		   const Node                     &root,
+		   const std::vector<std::string> &prefixes,
+		   const size_t                    k)
+{
+  detail::OrderedLeavesIterator<
+    Node, detail::BinaryHeapFrontier, Prefetch> visit;
+
+  size_t count = 0;
+  std::uint64_t checksum = 0;
+  std::uint64_t cycles = 0;
+
+  const auto seconds = measure_seconds ([&]
+  {
+    const auto start = read_cycles ();
+
+    for (const auto &prefix : prefixes)
+    {
+      visit.reset (match (root, prefix));
+
+      for (size_t j = 0; visit && (j < k); ++visit, ++j)
+      {
+	checksum += visit->rank ();
+	++count;
+      }
+    }
+
+    cycles = read_cycles () - start;
+  });
+
+  std::cout << "  " << name
+	    << " completions=" << count
+	    << " ns/completion=" << (seconds * 1e9 / count);
+
+  if (cycles)
+  {
+    std::cout << " cycles/completion="
+	      << (static_cast<double> (cycles) / count);
+  }
+
+  std::cout << " (checksum " << checksum << ")" << std::endl;
+}
+
+void benchmark_prefetch ()
+{
+  const auto suggestions =
+    make_random_suggestions (data_set_size (9000000), 26, 24, 7);
+
+  const auto trie =
+    detail::make_serialised_ordered_trie (suggestions);
+
+  const auto root = detail::make_trie_root (trie.data ());
+
+  std::vector<std::string> prefixes;
+  std::mt19937_64 rng {3};
+  std::uniform_int_distribution<size_t> pick {0, suggestions.size () - 1};
+
+  for (size_t j = 0; j < 20000; ++j)
+  {
+    prefixes.push_back (suggestions[pick (rng)].first.substr (0, 3));
+  }
+
+  std::cout << "prefetch: " << suggestions.size ()
+	    << " suggestions, trie size " << trie.size ()
+	    << " bytes, top-100 of " << prefixes.size ()
+	    << " random prefixes" << std::endl;
+
+  run_prefetch<detail::NoPrefetch> ("no_prefetch      ", root, prefixes, 100);
+  run_prefetch<detail::PrefetchChildren> ("prefetch_children", root, prefixes, 100);
+  run_prefetch<detail::NoPrefetch> ("no_prefetch      ", root, prefixes, 100);
+  run_prefetch<detail::PrefetchChildren> ("prefetch_children", root, prefixes, 100);
+}
+
+/*
+ * Serve top-10 queries for the shortest prefixes, with and
+ * without precomputed top-k lists.
+ */
+void run_top_k (const char                       *name,
+		const OrderedTrie<std::uint64_t> &trie,
+		const std::vector<std::string>   &prefixes)
+{
+  OrderedTrie<std::uint64_t>::QueryContext context;
+  size_t count = 0;
+  std::uint64_t checksum = 0;
+
+  const auto seconds = measure_seconds ([&]
+  {
+    for (size_t round = 0; round < 100; ++round)
+    {
+      for (const auto &prefix : prefixes)
+      {
+	size_t j = 0;
+
+	for (const auto &completion : trie.complete (prefix, context))
+	{
+	  checksum += completion.score ();
+	  ++count;
+
+	  if (++j == 10)
+	  {
+	    break;
+	  }
+	}
+      }
+    }
+  });
+
+  std::cout << "  " << name
+	    << " us/query=" << (seconds * 1e6 * 10 / count)
+	    << " (checksum " << checksum << ")" << std::endl;
+}
+
+void benchmark_top_k ()
+{
+  const auto suggestions =
+    make_random_suggestions (data_set_size (2000000), 26, 12, 5);
+
+  std::vector<std::string> prefixes {""};
+
+  for (char c = 'a'; c <= 'z'; ++c)
+  {
+    prefixes.push_back (std::string (1, c));
+    prefixes.push_back (std::string (1, c) + 'e');
+  }
+
+  BuildOptions options;
+  options.top_k = 10;
+
+  const auto plain = make_ordered_trie (suggestions);
+  const auto top_k = make_ordered_trie (
+    suggestions, std::greater<> {}, options);
+
+  std::cout << "top_k: " << suggestions.size ()
+	    << " suggestions, top-10 of " << prefixes.size ()
+	    << " short prefixes" << std::endl;
+
+  run_top_k ("heap_visit", plain, prefixes);
+  run_top_k ("top_k     ", top_k, prefixes);
+}
+
+/*
+ * Look up random suggestions, half of them missing, one at a
+ * time and in interleaved batches.
+ */
+void benchmark_batch ()
+{
+  const auto suggestions =
+    make_random_suggestions (data_set_size (9000000), 26, 24, 11);
+
+  const auto trie = make_ordered_trie (suggestions);
+
+  std::vector<std::string> queries;
+  std::mt19937_64 rng {13};
+  std::uniform_int_distribution<size_t> pick {0, suggestions.size () - 1};
+
+  for (size_t j = 0; j < 1000000; ++j)
+  {
+    queries.push_back (suggestions[pick (rng)].first);
+
+    if (j % 2)
+    {
+      queries.back ().back () = '!';
+    }
+  }
+
+  std::cout << "batch: " << suggestions.size ()
+	    << " suggestions, " << queries.size ()
+	    << " lookups" << std::endl;
+
+  size_t found = 0;
+
+  const auto single = measure_seconds ([&]
+  {
+    for (const auto &query : queries)
+    {
+      found += trie.count (query);
+    }
+  });
+
+  std::cout << "  count       ns/lookup=" << (single * 1e9 / queries.size ())
+	    << " (found " << found << ")" << std::endl;
+
+  found = 0;
+
+  const auto batched = measure_seconds ([&]
+  {
+    for (const auto c : trie.count_batch (queries))
+    {
+      found += c;
+    }
+  });
+
+  std::cout << "  count_batch ns/lookup=" << (batched * 1e9 / queries.size ())
+	    << " (found " << found << ")" << std::endl;
+}
+
+/*
+ * Look up sorted random suggestions, half of them missing, one
+ * at a time and resuming from the path of the previous one.
+ */
+void benchmark_sorted ()
+{
+  const auto suggestions =
+    make_random_suggestions (data_set_size (9000000), 26, 24, 11);
+
+  const auto trie = make_ordered_trie (suggestions);
+
+  std::vector<std::string> queries;
+  std::mt19937_64 rng {17};
+  std::uniform_int_distribution<size_t> pick {0, suggestions.size () - 1};
+
+  for (size_t j = 0; j < 1000000; ++j)
+  {
+    queries.push_back (suggestions[pick (rng)].first);
+
+    if (j % 2)
+    {
+      queries.back ().back () = '!';
+    }
+  }
+
+  std::sort (queries.begin (), queries.end ());
+
+  std::cout << "sorted: " << suggestions.size ()
+	    << " suggestions, " << queries.size ()
+	    << " sorted lookups" << std::endl;
+
+  size_t found = 0;
+
+  const auto single = measure_seconds ([&]
+  {
+    for (const auto &query : queries)
+    {
+      found += trie.count (query);
+    }
+  });
+
+  std::cout << "  count        ns/lookup=" << (single * 1e9 / queries.size ())
+	    << " (found " << found << ")" << std::endl;
+
+  std::vector<size_t> counts;
+  counts.reserve (queries.size ());
+
+  const auto sorted = measure_seconds ([&]
+  {
+    trie.count_sorted (queries, std::back_inserter (counts));
+  });
+
+  found = std::accumulate (counts.begin (), counts.end (), size_t {0});
+
+  std::cout << "  count_sorted ns/lookup=" << (sorted * 1e9 / queries.size ())
+	    << " (found " << found << ")" << std::endl;
+}
+
+/*
+ * Complete random prefixes of random suggestions on a growing
+ * number of threads, each counting its completions apart.
+ */
+void benchmark_parallel ()
+{
+  const auto suggestions =
+    make_random_suggestions (data_set_size (9000000), 26, 24, 11);
+
+  const auto trie = make_ordered_trie (suggestions);
+
+  std::vector<std::string> prefixes;
+  std::mt19937_64 rng {19};
+  std::uniform_int_distribution<size_t> pick {0, suggestions.size () - 1};
+
+  for (size_t j = 0; j < 1000000; ++j)
+  {
+    const auto &s = suggestions[pick (rng)].first;
+    prefixes.push_back (s.substr (0, 1 + rng () % s.size ()));
+  }
+
+  const auto max_threads =
+    std::max<size_t> (std::thread::hardware_concurrency (), 1);
+
+  std::cout << "parallel: " << suggestions.size ()
+	    << " suggestions, top-10 of " << prefixes.size ()
+	    << " prefixes, up to " << max_threads << " threads" << std::endl;
+
+  double baseline = 0;
+
+  for (size_t threads = 1; ; threads = std::min (2 * threads, max_threads))
+  {
+    /*
+     * Counters padded apart, to keep workers from sharing lines
+     */
+    std::vector<std::array<size_t, 8>> found (threads);
+
+    const auto seconds = measure_seconds ([&]
+    {
+      trie.parallel_complete (
+	prefixes, 10,
+	[&found] (const size_t worker, size_t, const auto &completions)
+	{
+	  found[worker][0] += completions.size ();
+	},
+	threads);
+    });
+
+    if (threads == 1)
+    {
+      baseline = seconds;
+    }
+
+    size_t total = 0;
+
+    for (const auto &f : found)
+    {
+      total += f[0];
+    }
+
+    std::cout << "  threads=" << threads
+	      << " ns/prefix=" << (seconds * 1e9 / prefixes.size ())
+	      << " speedup=" << (baseline / seconds)
+	      << " (found " << total << ")" << std::endl;
+
+    if (threads == max_threads)
+    {
+      break;
+    }
+  }
+}
+
+/*
+ * Dump all suggestions by rank through begin(), and through
+ * parallel_export() in each order.
+ */
+void benchmark_export ()
+{
+  const auto suggestions =
+    make_random_suggestions (data_set_size (9000000), 26, 24, 11);
+
+  const auto trie = make_ordered_trie (suggestions);
+  using Trie = std::decay_t<decltype (trie)>;
+
+  std::cout << "export: " << suggestions.size ()
+	    << " suggestions, up to "
+	    << std::max (std::thread::hardware_concurrency (), 1u)
+	    << " threads" << std::endl;
+
+  size_t bytes = 0;
+
+  const auto single = measure_seconds ([&]
+  {
+    for (const auto &s : boost::make_iterator_range (trie.begin (), trie.end ()))
+    {
+      bytes += s.first.size ();
+    }
+  });
+
+  std::cout << "  begin ()       s=" << single
+	    << " (bytes " << bytes << ")" << std::endl;
+
+  const std::pair<const char*, Trie::ExportOrder> orders[] =
+  {
+    {"lexicographic ", Trie::EXPORT_LEXICOGRAPHIC},
+    {"partition_rank", Trie::EXPORT_PARTITION_RANK},
+    {"rank          ", Trie::EXPORT_RANK}
+  };
+
+  for (const auto &order : orders)
+  {
+    bytes = 0;
+
+    const auto seconds = measure_seconds ([&]
+    {
+      for (const auto &p : trie.parallel_export (order.second))
+      {
+	for (const auto &s : p)
+	{
+	  bytes += s.first.size ();
+	}
+      }
+    });
+
+    std::cout << "  " << order.first << " s=" << seconds
+	      << " (bytes " << bytes << ")" << std::endl;
+  }
+}
+
+/*
+ * Look up random strings, mostly missing, with and without
+ * a filter built along the trie.
+ */
+void benchmark_filter ()
+{
+  const auto suggestions =
+    make_random_suggestions (data_set_size (9000000), 26, 24, 11);
+
+  BuildOptions options;
+  options.filter_bits_per_key = 10;
+
+  const auto plain = make_ordered_trie (suggestions);
+  const auto filtered = make_ordered_trie (
+    suggestions, std::greater<> {}, options);
+
+  std::vector<std::string> queries;
+  std::mt19937_64 rng {23};
+  std::uniform_int_distribution<size_t> pick {0, suggestions.size () - 1};
+
+  for (size_t j = 0; j < 1000000; ++j)
+  {
+    queries.push_back (suggestions[pick (rng)].first);
+
+    if (j % 10)
+    {
+      queries.back ().back () = '!';
+    }
+  }
+
+  std::cout << "filter: " << suggestions.size ()
+	    << " suggestions, " << queries.size ()
+	    << " lookups, 90% missing" << std::endl;
+
+  for (const auto &run : {std::make_pair ("no filter", &plain),
+			  std::make_pair ("filter   ", &filtered)})
+  {
+    size_t found = 0;
+
+    const auto seconds = measure_seconds ([&]
+    {
+      for (const auto &query : queries)
+      {
+	found += run.second->count (query);
+      }
+    });
+
+    std::cout << "  " << run.first
+	      << " ns/lookup=" << (seconds * 1e9 / queries.size ())
+	      << " (found " << found << ")" << std::endl;
+  }
+}
+
+} // namespace {
+
+int main (int argc, char **argv)
+{
+  const std::map<std::string, std::function<void ()>> benchmarks =
+  {
+    {"batch", benchmark_batch},
+    {"export", benchmark_export},
+    {"filter", benchmark_filter},
+    {"frontier", benchmark_frontier},
+    {"parallel", benchmark_parallel},
+    {"prefetch", benchmark_prefetch},
+    {"sorted", benchmark_sorted},
+    {"top_k", benchmark_top_k}
+  };
+
+  if (argc == 1)
+  {
+    for (const auto &b : benchmarks)
+    {
+      b.second ();
+    }
+
+    return 0;
+  }
+
+  for (int j = 1; j < argc; ++j)
+  {
+    const auto it = benchmarks.find (argv[j]);
+
+    if (it == benchmarks.end ())
+    {
+      std::cerr << "Unknown benchmark: " << argv[j] << std::endl;
+      return 1;
+    }
+
+    it->second ();
+  }
+
+  return 0;
+}
@@ -0,0 +1,401 @@
+/**
+ * @file  detail/ordered_trie_batch.hpp
+ * @brief Interleaved descents of several keys, overlapping
+ *        their cache misses.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_BATCH_HPP
+#define DETAIL_ORDERED_TRIE_BATCH_HPP
+
+#include "ordered_trie_iterator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/**
+ * Number of descents interleaved by batched lookups, enough to
+ * keep busy the line fill buffers of a core
+ */
+constexpr std::size_t interleaved_descents = 16;
+
+/**
+ * Descent of the trie along a key, advanced one level at a
+ * time by step(). Each step decodes the children of current
+ * node, whose headers were prefetched by the previous one, so
+ * that interleaving the steps of several descents overlaps
+ * their cache misses.
+ *
+ * An exact descent succeeds on the leaf spelling the key (as
+ * find_leaf()), a prefix descent on the node whose path spells
+ * the key as a prefix (as prefix_match()).
+ */
+template<typename Node, typename FwdIt>
+class Descent
+{
+public:
+
+  Descent () = default;
+
+  Descent (const Node &root,
+	   FwdIt       first,
+	   FwdIt       last,
+	   const bool  exact)
+    : m_locus (root)
+    , m_first (std::move (first))
+    , m_last (std::move (last))
+    , m_exact (exact)
+  {
+  }
+
+  /**
+   * Descend one level. Returns whether the descent is over,
+   * successfully or not.
+   */
+  bool step ();
+
+  /**
+   * Whether the descent succeeded
+   */
+  bool found () const
+  {
+    return m_state == FOUND;
+  }
+
+  /**
+   * Node the descent succeeded on
+   */
+  const Node& locus () const
+  {
+    return m_locus;
+  }
+
+  /**
+   * Number of key bytes spelled by the ancestors of locus()
+   */
+  std::size_t depth () const
+  {
+    return m_depth;
+  }
+
+private:
+
+  enum State { RUNNING, FOUND, MISSING };
+
+  bool finish (const State state)
+  {
+    m_state = state;
+    return true;
+  }
+
+  Node m_locus;
+  FwdIt m_first;
+  FwdIt m_last;
+  std::size_t m_depth = 0;
+  std::size_t m_consumed = 0;
+  bool m_exact = true;
+  State m_state = RUNNING;
+};
+
+/**
+ * Exact lookups of a sequence of keys, each resuming the
+ * descent from the deepest node on the path of the previous
+ * key spelling a prefix of their longest common prefix. On
+ * sorted keys, this visits once the nodes shared by their
+ * paths.
+ */
+template<typename Node>
+class SharedPrefixLookup
+{
+public:
+
+  explicit SharedPrefixLookup (const Node &root)
+    : m_path {{root, 0}}
+  {
+  }
+
+  /**
+   * Find the leaf spelling [@p first, @p last) as find_leaf()
+   * does, storing it in @p leaf. Returns whether it exists.
+   */
+  template<typename FwdIt>
+  bool find (FwdIt first, const FwdIt last, Node &leaf);
+
+private:
+
+  /*
+   * Internal node on the path of previous key, together with
+   * the number of key bytes spelled up to the end of its label
+   */
+  struct Step
+  {
+    Node node;
+    std::size_t depth;
+  };
+
+  std::vector<Step> m_path;
+  std::string m_key;
+  std::string m_next;
+};
+
+/**
+ * Run the descents along the keys in [@p first, @p last) from
+ * @p root, advancing up to @p group_size of them in round robin
+ * and starting a new one as soon as another is over (AMAC).
+ * Calls @p on_done (j, descent) with the position j of each
+ * key, in no particular order.
+ */
+template<typename Node, typename FwdRangeIt, typename F>
+void interleave_descents (const Node        &root,
+			  FwdRangeIt         first,
+			  const FwdRangeIt   last,
+			  const bool         exact,
+			  const std::size_t  group_size,
+			  F                &&on_done);
+
+/***********************************************************
+ *
+ * ordered_trie_batch.hpp - Inlined implementation
+ *
+ ***********************************************************/
+
+template<typename Node, typename FwdIt>
+bool Descent<Node, FwdIt>::step ()
+{
+  const auto terminal = (m_first == m_last);
+
+  if (terminal && !m_exact)
+  {
+    return finish (FOUND);
+  }
+
+  if (m_locus.is_leaf ())
+  {
+    return finish (MISSING);
+  }
+
+  /*
+   * Look for the child labelled by next byte or, once the key
+   * is over, for the leaf terminating it
+   */
+  const auto byte = terminal ? 0u : static_cast<std::uint8_t> (*m_first);
+
+  auto children_it = find_sibling (
+    visit_children (m_locus), [terminal, byte] (const Node &node)
+    {
+      return terminal ?
+	(node.is_leaf () && !node.label_size ()) :
+	(node.label_size () && (*node.label_begin () == byte));
+    });
+
+  if (!children_it)
+  {
+    return finish (MISSING);
+  }
+
+  if (terminal)
+  {
+    m_locus = *children_it;
+    return finish (FOUND);
+  }
+
+  m_locus = *children_it;
+  m_depth = m_consumed;
+
+  const auto *label_ptr = m_locus.label_begin ();
+  const auto *label_end = label_ptr + m_locus.label_size ();
+
+  for (; (label_ptr != label_end) && (m_first != m_last);
+       ++label_ptr, ++m_first, ++m_consumed)
+  {
+    if (static_cast<std::uint8_t> (*m_first) != *label_ptr)
+    {
+      return finish (MISSING);
+    }
+  }
+
+  if (label_ptr != label_end)
+  {
+    return finish (m_exact ? MISSING : FOUND);
+  }
+
+  if (m_locus.is_leaf ())
+  {
+    return finish ((m_first == m_last) ? FOUND : MISSING);
+  }
+
+  /*
+   * The headers of wide sibling groups span a couple of lines
+   */
+#if defined (__GNUC__)
+  __builtin_prefetch (m_locus.first_child ());
+  __builtin_prefetch (m_locus.first_child () + 64);
+#endif
+
+  return false;
+}
+
+/***********************************************************/
+
+template<typename Node>
+template<typename FwdIt>
+bool SharedPrefixLookup<Node>::find (FwdIt first,
+				     const FwdIt last,
+				     Node &leaf)
+{
+  m_next.assign (first, last);
+
+  const auto common = static_cast<std::size_t> (
+    std::mismatch (
+      m_next.begin (),
+      m_next.begin () + std::min (m_next.size (), m_key.size ()),
+      m_key.begin ()).first - m_next.begin ());
+
+  while (m_path.back ().depth > common)
+  {
+    m_path.pop_back ();
+  }
+
+  std::swap (m_key, m_next);
+
+  auto locus = m_path.back ().node;
+  auto position = m_path.back ().depth;
+
+  while (position < m_key.size ())
+  {
+    const auto byte = static_cast<std::uint8_t> (m_key[position]);
+
+    auto children_it = find_sibling (
+      visit_children (locus), [byte] (const Node &node)
+      {
+	return node.label_size () && (*node.label_begin () == byte);
+      });
+
+    if (!children_it)
+    {
+      return false;
+    }
+
+    locus = *children_it;
+
+    const auto size = locus.label_size ();
+
+    if ((size > m_key.size () - position) ||
+	!std::equal (locus.label_begin () + 1,
+		     locus.label_begin () + size,
+		     m_key.begin () + position + 1,
+		     [] (const std::uint8_t lhs, const char rhs)
+		     {
+		       return lhs == static_cast<std::uint8_t> (rhs);
+		     }))
+    {
+      return false;
+    }
+
+    position += size;
+
+    if (!locus.is_leaf ())
+    {
+      m_path.push_back ({locus, position});
+    }
+  }
+
+  if (locus.is_leaf ())
+  {
+    leaf = locus;
+    return !(locus == m_path.front ().node);
+  }
+
+  auto leaf_it = find_sibling (
+    visit_children (locus),
+    [] (const Node &node)
+    {
+      return node.is_leaf () && !node.label_size ();
+    });
+
+  if (!leaf_it)
+  {
+    return false;
+  }
+
+  leaf = *leaf_it;
+  return true;
+}
+
+/***********************************************************/
+
+template<typename Node, typename FwdRangeIt, typename F>
+void interleave_descents (const Node        &root,
+			  FwdRangeIt         first,
+			  const FwdRangeIt   last,
+			  const bool         exact,
+			  const std::size_t  group_size,
+			  F                &&on_done)
+{
+  using KeyIt = decltype (std::begin (*first));
+
+  std::vector<std::pair<Descent<Node, KeyIt>, std::size_t>> group;
+  group.reserve (group_size);
+
+  std::size_t next = 0;
+
+  const auto start = [&] (Descent<Node, KeyIt> &descent,
+			  std::size_t          &position)
+  {
+    descent = Descent<Node, KeyIt>
+    {
+      root, std::begin (*first), std::end (*first), exact
+    };
+
+    position = next++;
+    ++first;
+  };
+
+  while ((group.size () < group_size) && (first != last))
+  {
+    group.emplace_back ();
+    start (group.back ().first, group.back ().second);
+  }
+
+  while (!group.empty ())
+  {
+    for (std::size_t j = 0; j < group.size ();)
+    {
+      auto &entry = group[j];
+
+      if (!entry.first.step ())
+      {
+	++j;
+	continue;
+      }
+
+      on_done (entry.second, entry.first);
+
+      if (first != last)
+      {
+	start (entry.first, entry.second);
+	++j;
+      }
+      else
+      {
+	entry = std::move (group.back ());
+	group.pop_back ();
+      }
+    }
+  }
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
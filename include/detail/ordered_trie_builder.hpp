@@ -10,14 +10,17 @@
 #define ORDERED_TRIE_DETAIL_ORDERED_TRIE_BUILDER_HPP
 
 #include "ordered_trie_builtin_serialise.hpp"
+#include "ordered_trie_iterator.hpp"
 #include "ordered_trie_node.hpp"
 #include "../ordered_trie_serialise.hpp"
 
 #include <boost/optional.hpp>
 #include <boost/range.hpp>
 #include <boost/range/adaptors.hpp>
+#include <boost/range/algorithm.hpp>
 #include <boost/utility/string_ref.hpp>
 
+#include <algorithm>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
@@ -40,11 +43,14 @@ public:
   MakeTrie () = default;
 
   /**
-   * Make leaf node
+   * Make leaf node, annotated with @p category_mask if
+   * SUBTREE_CATEGORY_MASKS is set in @p annotations.
    */
-  MakeTrie (std::string label,
-	    std::size_t rank,
-	    T           metadata);
+  MakeTrie (std::string         label,
+	    std::size_t         rank,
+	    T                   metadata,
+	    const std::uint64_t category_mask = 0,
+	    const std::uint64_t annotations = 0);
 
   /**
    * Make internal node
@@ -56,7 +62,8 @@ public:
    * Make root from children nodes
    */
   explicit MakeTrie (std::vector<MakeTrie> children,
-		     std::vector<std::uint8_t> header = {});
+		     std::vector<std::uint8_t> header = {},
+		     const std::uint64_t annotations = 0);
 
   /**
    * Minimum scores associated to any leave in the subtrie
@@ -69,9 +76,11 @@ public:
   const std::string &label () const;
 
   /**
-   * Add children nodes
+   * Add children nodes, appending the subtree annotations
+   * selected by @p annotations (see SubtreeAnnotation)
    */
-  void add_children (std::vector<MakeTrie> siblings);
+  void add_children (std::vector<MakeTrie>  siblings,
+		     const std::uint64_t    annotations = 0);
 
   /**
    * Extract subtrie data from this instance
@@ -92,6 +101,9 @@ private:
 private:
   std::string m_label;
   std::uint64_t m_rank = 0;
+  std::uint64_t m_max_rank = 0;
+  std::uint64_t m_leaf_count = 0;
+  std::uint64_t m_category_mask = 0;
   boost::optional<T> m_metadata;
   std::vector<std::uint8_t> m_subtree_serialised;
 };
@@ -107,15 +119,34 @@ auto make_serialised_ordered_trie (
 
 /**
  * @overload transforming input score in each pair
- * by mean of the given input functor to score component.
+ * by mean of the given input functor to score component,
+ * and annotating nodes as requested by the SubtreeAnnotation
+ * flags in @p annotations. With SUBTREE_CATEGORY_MASKS, the
+ * mask of each suggestion is taken from @p category_masks.
  */
 template<typename OrderedPairs,
          typename ScoreTransform>
 auto make_serialised_ordered_trie (
   const OrderedPairs   &suggestion_ranks,
-  const ScoreTransform &score_transform)
+  const ScoreTransform &score_transform,
+  const std::uint64_t   annotations = 0,
+  const std::vector<std::uint64_t> &category_masks = {})
   -> std::vector<std::uint8_t>;
 
+/**
+ * Serialise the top-k index (see ordered_trie_top_k.hpp) of
+ * trie rooted at @p root stored from @p trie, listing the
+ * first @p k leaves reached by the ordered visit @p Visitor
+ * of every subtrie holding more than @p threshold leaves, and
+ * the state of the visit past them. Returns an empty sequence
+ * if there is no such subtrie.
+ */
+template<typename Visitor, typename Node>
+std::vector<std::uint8_t> make_top_k_index (const Node         &root,
+					    const std::uint8_t *trie,
+					    const std::size_t   k,
+					    const std::size_t   threshold);
+
 /**
  * Score serialisation
  */
@@ -134,17 +165,30 @@ auto serialise_scores (
 
 /***********************************************************/
 template<typename T>
-MakeTrie<T>::MakeTrie (std::string label,
-		       std::size_t rank,
-		       T           metadata)
+MakeTrie<T>::MakeTrie (std::string         label,
+		       std::size_t         rank,
+		       T                   metadata,
+		       const std::uint64_t category_mask,
+		       const std::uint64_t annotations)
   : m_label (std::move (label))
   , m_rank (rank)
+  , m_max_rank (rank)
+  , m_leaf_count (1)
+  , m_category_mask (category_mask)
   , m_metadata (std::move (metadata))
 {
   if (label.size () >= Node<T>::max_label_size)
   {
     throw std::length_error ("Exceeded maximum label size");
   }
+
+  /*
+   * The subtrie of a leaf is empty, except for its mask
+   */
+  if (annotations & SUBTREE_CATEGORY_MASKS)
+  {
+    append_reversed_varint (m_subtree_serialised, category_mask);
+  }
 }
 
 /***********************************************************/
@@ -167,7 +211,8 @@ MakeTrie<T>::MakeTrie (std::string label,
 /***********************************************************/
 template<typename T>
 MakeTrie<T>::MakeTrie (std::vector<MakeTrie<T>> siblings,
-		       std::vector<std::uint8_t> serialised)
+		       std::vector<std::uint8_t> serialised,
+		       const std::uint64_t       annotations)
   : m_subtree_serialised (std::move (serialised))
 {    
   /*
@@ -178,7 +223,7 @@ MakeTrie<T>::MakeTrie (std::vector<MakeTrie<T>> siblings,
 
   if (!siblings.empty ())
   {
-    add_children (std::move (siblings));
+    add_children (std::move (siblings), annotations);
   }
 }
 
@@ -310,7 +355,8 @@ void MakeTrie<T>::serialise_siblings (
 /***********************************************************/
 template<typename T> 
 void MakeTrie<T>::add_children (
-  std::vector<MakeTrie<T>> siblings)
+  std::vector<MakeTrie<T>> siblings,
+  const std::uint64_t      annotations)
 {
   if (m_metadata)
   {
@@ -357,6 +403,9 @@ void MakeTrie<T>::add_children (
 
 	m_subtree_serialised = std::move (child.m_subtree_serialised);
 	m_rank               = child.m_rank;
+	m_max_rank           = child.m_max_rank;
+	m_leaf_count         = child.m_leaf_count;
+	m_category_mask      = child.m_category_mask;
 	m_metadata           = std::move (child.m_metadata);
 	return;
     }
@@ -372,11 +421,240 @@ void MakeTrie<T>::add_children (
     });
 
   m_rank = called_from_root ? 0 : siblings.begin ()->m_rank;
+  m_max_rank = 0;
+  m_leaf_count = 0;
+  m_category_mask = 0;
+
+  for (const auto &node : siblings)
+  {
+    m_max_rank = std::max (m_max_rank, node.m_max_rank);
+    m_leaf_count += node.m_leaf_count;
+    m_category_mask |= node.m_category_mask;
+  }
 
   serialise_siblings (
     m_subtree_serialised,
     siblings,
     m_rank);
+
+  /*
+   * Annotations follow the subtrie, to be read backward
+   * from its end (see SubtreeAnnotation)
+   */
+  if (annotations & SUBTREE_RANK_RANGES)
+  {
+    append_reversed_varint (m_subtree_serialised, m_max_rank - m_rank);
+  }
+
+  if (annotations & SUBTREE_LEAF_COUNTS)
+  {
+    append_reversed_varint (m_subtree_serialised, m_leaf_count);
+  }
+
+  if (annotations & SUBTREE_CATEGORY_MASKS)
+  {
+    append_reversed_varint (m_subtree_serialised, m_category_mask);
+  }
+}
+
+/***********************************************************/
+template<typename Visitor, typename Node>
+std::vector<std::uint8_t> make_top_k_index (const Node         &root,
+					    const std::uint8_t *trie,
+					    const std::size_t   k,
+					    const std::size_t   threshold)
+{
+  if ((k == 0) || root.is_leaf ())
+  {
+    return {};
+  }
+
+  /*
+   * Collect heavy nodes by a post-order visit counting
+   * the leaves of every subtrie
+   */
+  std::vector<Node> heavy;
+
+  struct Frame
+  {
+    Node node;
+    SiblingsIterator<Node> children;
+    std::size_t leaves;
+  };
+
+  std::vector<Frame> stack {{root, visit_children (root), 0}};
+
+  while (!stack.empty ())
+  {
+    auto &top = stack.back ();
+
+    if (top.children)
+    {
+      const auto child = *top.children;
+      ++top.children;
+
+      if (child.is_leaf ())
+      {
+	++top.leaves;
+      }
+      else
+      {
+	stack.push_back ({child, visit_children (child), 0});
+      }
+
+      continue;
+    }
+
+    const auto done = top;
+    stack.pop_back ();
+
+    if (done.leaves > threshold)
+    {
+      heavy.push_back (done.node);
+    }
+
+    if (!stack.empty ())
+    {
+      stack.back ().leaves += done.leaves;
+    }
+  }
+
+  if (heavy.empty ())
+  {
+    return {};
+  }
+
+  std::sort (heavy.begin (), heavy.end ());
+
+  /*
+   * Record the first leaves of the visit of each heavy subtrie,
+   * with the labels chains leading to them and the frontier
+   * left past them
+   */
+  std::vector<std::uint64_t> nodes;
+  std::vector<std::uint64_t> leaves;
+  std::vector<std::uint64_t> states;
+  std::vector<std::uint64_t> state_offsets;
+  Visitor visit;
+
+  std::vector<std::size_t> paths;
+  std::vector<FrontierEntry<Node>> entries;
+  std::vector<std::size_t> links;
+
+  for (const auto &node : heavy)
+  {
+    nodes.push_back (node.data () - trie);
+    nodes.push_back (leaves.size () / 3);
+
+    visit.reset ();
+    visit.retain_links ();
+    visit.seed (
+      SiblingsIterator<Node> {node, Node::skip (node.data ())});
+
+    paths.clear ();
+
+    for (std::size_t j = 0; visit && (j < k); ++visit, ++j)
+    {
+      leaves.push_back (visit->data () - trie);
+      leaves.push_back (visit->rank ());
+      leaves.push_back (visit->first_child () - trie);
+      paths.push_back (visit.path ());
+    }
+
+    entries.clear ();
+    visit.for_each_entry ([&entries] (const FrontierEntry<Node> &entry)
+    {
+      entries.push_back (entry);
+    });
+
+    std::sort (entries.begin (), entries.end ());
+
+    /*
+     * Keep the reachable links, in arena order: parents come
+     * before their children
+     */
+    links.clear ();
+
+    const auto reach = [&] (std::size_t link)
+    {
+      for (; link != Visitor::no_link; link = visit.link (link).parent)
+      {
+	links.push_back (link);
+      }
+    };
+
+    boost::for_each (paths, reach);
+
+    for (const auto &entry : entries)
+    {
+      reach (entry.path);
+    }
+
+    std::sort (links.begin (), links.end ());
+    links.erase (std::unique (links.begin (), links.end ()), links.end ());
+
+    const auto encode_link = [&links] (const std::size_t link)
+      -> std::uint64_t
+    {
+      return (link == Visitor::no_link) ? 0u :
+	(std::lower_bound (links.begin (), links.end (), link) -
+	 links.begin () + 1);
+    };
+
+    state_offsets.push_back (states.size ());
+    states.push_back (links.size ());
+
+    for (const auto link : links)
+    {
+      const auto &l = visit.link (link);
+      states.push_back (l.label - trie);
+      states.push_back (l.size);
+      states.push_back (encode_link (l.parent));
+    }
+
+    for (const auto path : paths)
+    {
+      states.push_back (encode_link (path));
+    }
+
+    states.push_back (entries.size ());
+
+    for (const auto &entry : entries)
+    {
+      const auto &n = *entry.siblings;
+      states.push_back (n.data () - trie);
+      states.push_back (n.rank ());
+      states.push_back (n.first_child () - trie);
+      states.push_back (entry.siblings.end_siblings_range () - trie);
+      states.push_back (encode_link (entry.path));
+    }
+  }
+
+  std::vector<std::uint8_t> result;
+  result.reserve ((2 + nodes.size () + leaves.size () + heavy.size () +
+		   states.size ()) * sizeof (std::uint64_t));
+
+  const auto append_word = [&result] (const std::uint64_t w)
+  {
+    ordered_trie::serialise (result, w);
+  };
+
+  append_word (heavy.size ());
+  boost::for_each (nodes, append_word);
+  append_word (leaves.size () / 3);
+  boost::for_each (leaves, append_word);
+
+  const auto states_first =
+    2 + nodes.size () + leaves.size () + heavy.size ();
+
+  for (const auto offset : state_offsets)
+  {
+    append_word (states_first + offset);
+  }
+
+  boost::for_each (states, append_word);
+
+  return result;
 }
 
 /**********************************************************************/
@@ -436,7 +714,9 @@ std::vector<std::uint8_t>
 make_serialised_ordered_trie (
   const SuggestionsRange   &suggestions,
   const ScoresRange        &scores,
-  const MetadataRange      &metadata)
+  const MetadataRange      &metadata,
+  const std::uint64_t       annotations = 0,
+  const std::vector<std::uint64_t> &category_masks = {})
 {
   using MetadataType =
     typename boost::range_value<MetadataRange>::type;
@@ -446,6 +726,17 @@ make_serialised_ordered_trie (
 
   auto scores_it   = std::begin (scores);
   auto metadata_it = std::begin (metadata);
+  auto masks_it    = std::begin (category_masks);
+
+  const bool masked = (annotations & SUBTREE_CATEGORY_MASKS);
+
+  if (masked &&
+      (category_masks.size () !=
+       static_cast<std::size_t> (boost::distance (suggestions))))
+  {
+    throw std::length_error (
+      "Category masks and suggestions range of differing sizes");
+  }
 
   std::vector<TrieLevel> levels;
 
@@ -454,7 +745,7 @@ make_serialised_ordered_trie (
    * bottom up until there are only target_depth levels
    */
   const auto merge_levels =
-    [&levels] (const size_t target_depth)
+    [&levels, annotations] (const size_t target_depth)
     {
       BOOST_ASSERT (target_depth >= 1);
       BOOST_ASSERT (target_depth <= levels.size ());
@@ -466,7 +757,8 @@ make_serialised_ordered_trie (
 	BOOST_ASSERT (!current_level.empty ());
 	BOOST_ASSERT (!father_level.empty ());
 	
-	father_level.back ().add_children (std::move (current_level));
+	father_level.back ().add_children (std::move (current_level),
+					   annotations);
 	levels.pop_back ();
       }
     };
@@ -524,7 +816,11 @@ make_serialised_ordered_trie (
 	levels[idx].push_back ({std::string (1, c), {}});
       }
 
-      levels.back ().push_back ({"", *scores_it, *metadata_it});
+      levels.back ().push_back ({"",
+				 *scores_it,
+				 *metadata_it,
+				 masked ? *masks_it++ : 0,
+				 annotations});
 
       BOOST_ASSERT (std::all_of (levels.begin (),
 				 levels.end (),
@@ -556,7 +852,9 @@ make_serialised_ordered_trie (
    * Complete trie construction by merging remaining levels
    */
   merge_levels (1);
-  return BuilderNode {std::move (levels.back ())}.move_to_trie ();
+  return BuilderNode {std::move (levels.back ()),
+		      {},
+		      annotations}.move_to_trie ();
 }
 
 /*************************************************************/
@@ -565,7 +863,9 @@ template<typename OrderedPairs,
 	 typename ScoreTransform>
 std::vector<std::uint8_t>
 make_serialised_ordered_trie (const OrderedPairs   &completions,
-			      const ScoreTransform &score_transform)
+			      const ScoreTransform &score_transform,
+			      const std::uint64_t   annotations,
+			      const std::vector<std::uint64_t> &category_masks)
 {
   using boost::adaptors::transformed;
 
@@ -593,7 +893,9 @@ make_serialised_ordered_trie (const OrderedPairs   &completions,
   return make_serialised_ordered_trie (
     suggestions_range,
     scores_range,
-    metadata_range);				
+    metadata_range,
+    annotations,
+    category_masks);				
 }
 
 /*************************************************************/
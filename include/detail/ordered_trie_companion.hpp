@@ -0,0 +1,622 @@
+/**
+ * @file  detail/ordered_trie_companion.hpp
+ * @brief Secondary tries indexing transformed keys of the
+ *        suggestions of the main trie.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_COMPANION_HPP
+#define DETAIL_ORDERED_TRIE_COMPANION_HPP
+
+#include "ordered_trie_builder.hpp"
+#include "ordered_trie_builtin_serialise.hpp"
+#include "ordered_trie_fold.hpp"
+#include "ordered_trie_iterator.hpp"
+#include "ordered_trie_lexicographic.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/*
+ * A companion trie indexes keys derived from the suggestions
+ * of the main trie (e.g. their case folded form). Each key is
+ * followed by a fixed width big-endian reference to the leaf
+ * of the originating suggestion in the main trie, which makes
+ * keys unique, and its leaf has the rank of such suggestion.
+ * Hence its ordered visit enumerates the originating leaves by
+ * increasing rank.
+ *
+ * References are indices in the ancestors table of the main
+ * trie, listing each of its nodes after its parent as pairs
+ * of fixed width big-endian fields:
+ *
+ * @code
+ * {
+ *    offset : byte[width];   // of the node in the main trie
+ *    parent : byte[width];   // 1 + index of parent, 0 for root
+ * };
+ * @endcode
+ *
+ * so that the string of a leaf is spelled by walking up its
+ * ancestors. The table is stored with the companion tries as
+ * a companion of kind COMPANION_ANCESTORS, required whenever
+ * there is any other.
+ *
+ * The companion tries of a main trie are stored in a single
+ * segment as a sequence of 64 bit words:
+ *
+ * @code
+ * {
+ *    companions_count : word;
+ *    companions       : {kind   : word;
+ *                        width  : word;
+ *                        offset : word;   // from segment begin
+ *                        size   : word}[companions_count];
+ *    data             : byte[];
+ * };
+ * @endcode
+ */
+
+/**
+ * Kinds of companion tries
+ */
+enum CompanionKind : std::uint64_t
+{
+  COMPANION_FOLDED      = 1,
+  COMPANION_WORD_STARTS = 2,
+  COMPANION_REVERSED    = 3,
+  COMPANION_ANCESTORS   = 4
+};
+
+/**
+ * View over a companion trie, or the ancestors table
+ */
+struct CompanionTrie
+{
+  const std::uint8_t *first = nullptr;
+  const std::uint8_t *last = nullptr;
+  std::size_t width = 0;
+
+  bool empty () const
+  {
+    return first == last;
+  }
+};
+
+/**
+ * Number of bytes of the references into a trie of @p size bytes
+ */
+inline std::size_t reference_width (const std::uint64_t size)
+{
+  std::size_t result = 1;
+
+  while ((result < sizeof (std::uint64_t)) && (size >> (8 * result)))
+  {
+    ++result;
+  }
+
+  return result;
+}
+
+/**
+ * Ancestors table of a main trie
+ */
+struct AncestorsTable
+{
+  std::size_t width = 0;
+  std::vector<std::uint8_t> serialised;
+
+  /*
+   * Index of each leaf, by address
+   */
+  std::unordered_map<const std::uint8_t*, std::uint64_t> leaves;
+};
+
+/**
+ * Build the ancestors table of the trie rooted at @p root,
+ * stored in [@p trie, @p trie_end)
+ */
+template<typename Node>
+AncestorsTable make_ancestors_table (const Node         &root,
+				     const std::uint8_t *trie,
+				     const std::uint8_t *trie_end)
+{
+  AncestorsTable result;
+
+  /*
+   * Nodes are listed when their parent is expanded, hence
+   * after it
+   */
+  std::vector<std::pair<Node, std::uint64_t>> nodes {{root, 0}};
+
+  for (std::size_t j = 0; j < nodes.size (); ++j)
+  {
+    const auto node = nodes[j].first;
+
+    if (node.is_leaf ())
+    {
+      result.leaves.emplace (node.data (), j);
+      continue;
+    }
+
+    for (auto it = visit_children (node); it; ++it)
+    {
+      nodes.emplace_back (*it, j + 1);
+    }
+  }
+
+  result.width = reference_width (
+    std::max<std::uint64_t> (trie_end - trie, nodes.size ()));
+
+  result.serialised.reserve (2 * result.width * nodes.size ());
+
+  const auto append_field = [&result] (const std::uint64_t value)
+  {
+    for (std::size_t j = result.width; j--; )
+    {
+      result.serialised.push_back (static_cast<std::uint8_t> (value >> (8 * j)));
+    }
+  };
+
+  for (const auto &node : nodes)
+  {
+    append_field (node.first.data () - trie);
+    append_field (node.second);
+  }
+
+  return result;
+}
+
+/**
+ * Serialise the companion trie of the trie rooted at @p root,
+ * whose ancestors table is @p ancestors, indexing the keys
+ * passed by @p keys_of (s, emit) to emit (key) for each
+ * suggestion s.
+ */
+template<typename Node, typename KeysOf>
+std::vector<std::uint8_t> make_companion_trie (const Node           &root,
+					       const AncestorsTable &ancestors,
+					       const KeysOf         &keys_of)
+{
+  const auto width = ancestors.width;
+
+  std::vector<std::pair<std::string, std::uint64_t>> entries;
+  std::string suggestion;
+
+  for (LexicographicIterator<Node> it {root}; it; ++it)
+  {
+    const auto index = ancestors.leaves.at (it->data ());
+    std::string reference (width, '\0');
+
+    for (std::size_t j = 0; j < width; ++j)
+    {
+      reference[width - 1 - j] = static_cast<char> (index >> (8 * j));
+    }
+
+    suggestion.clear ();
+    it.write_string (suggestion);
+
+    keys_of (suggestion, [&] (std::string key)
+    {
+      key += reference;
+      entries.emplace_back (std::move (key), it->rank ());
+    });
+  }
+
+  std::sort (entries.begin (), entries.end ());
+  return make_serialised_ordered_trie (entries);
+}
+
+/**
+ * Serialise the segment hosting the given (kind, width, trie)
+ * companion tries
+ */
+inline std::vector<std::uint8_t> make_companions_segment (
+  const std::vector<std::tuple<std::uint64_t,
+			       std::uint64_t,
+			       std::vector<std::uint8_t>>> &companions)
+{
+  std::vector<std::uint8_t> result;
+
+  if (companions.empty ())
+  {
+    return result;
+  }
+
+  const auto append_word = [&result] (const std::uint64_t w)
+  {
+    ordered_trie::serialise (result, w);
+  };
+
+  std::uint64_t offset =
+    (1 + 4 * companions.size ()) * sizeof (std::uint64_t);
+
+  append_word (companions.size ());
+
+  for (const auto &c : companions)
+  {
+    append_word (std::get<0> (c));
+    append_word (std::get<1> (c));
+    append_word (offset);
+    append_word (std::get<2> (c).size ());
+    offset += std::get<2> (c).size ();
+  }
+
+  for (const auto &c : companions)
+  {
+    result.insert (result.end (),
+		   std::get<2> (c).begin (),
+		   std::get<2> (c).end ());
+  }
+
+  return result;
+}
+
+/**
+ * Read-only view over the companion tries segment
+ */
+class CompanionDirectory
+{
+public:
+
+  /**
+   * No companion tries
+   */
+  CompanionDirectory () = default;
+
+  /**
+   * Segment serialised in [@p first, @p last). Throws
+   * std::runtime_error on inconsistent serialisation, or
+   * if the ancestors table is missing.
+   */
+  explicit CompanionDirectory (const std::uint8_t *first,
+			       const std::uint8_t *last)
+    : m_first (first)
+  {
+    if (first == last)
+    {
+      return;
+    }
+
+    const auto size = static_cast<std::uint64_t> (last - first);
+
+    if (size < word_size)
+    {
+      throw std::runtime_error ("Invalid companions segment size");
+    }
+
+    const auto count = word (0);
+
+    if (count > (size / word_size - 1) / 4)
+    {
+      throw std::runtime_error ("Invalid companions segment size");
+    }
+
+    bool ancestors = false;
+
+    for (std::size_t j = 0; j < count; ++j)
+    {
+      const auto kind = word (1 + 4 * j);
+      const auto width = word (2 + 4 * j);
+      const auto offset = word (3 + 4 * j);
+      const auto length = word (4 + 4 * j);
+
+      if ((width == 0) || (width > word_size) ||
+	  (offset > size) || (length > size - offset) || (length == 0))
+      {
+	throw std::runtime_error ("Invalid companions segment entry");
+      }
+
+      ancestors = ancestors || (kind == COMPANION_ANCESTORS);
+    }
+
+    if ((count != 0) && !ancestors)
+    {
+      throw std::runtime_error ("Companions segment without ancestors table");
+    }
+
+    m_count = count;
+  }
+
+  /**
+   * Companion trie of given @p kind (empty if absent)
+   */
+  CompanionTrie find (const std::uint64_t kind) const
+  {
+    CompanionTrie result;
+
+    for (std::size_t j = 0; j < m_count; ++j)
+    {
+      if (word (1 + 4 * j) == kind)
+      {
+	result.first = m_first + word (3 + 4 * j);
+	result.last = result.first + word (4 + 4 * j);
+	result.width = word (2 + 4 * j);
+	break;
+      }
+    }
+
+    return result;
+  }
+
+private:
+
+  static constexpr std::size_t word_size = sizeof (std::uint64_t);
+
+  std::uint64_t word (const std::size_t j) const
+  {
+    return ordered_trie::deserialise<std::uint64_t> (
+      m_first + j * word_size);
+  }
+
+  const std::uint8_t *m_first = nullptr;
+  std::size_t m_count = 0;
+};
+
+/**
+ * Iterate the leaves of the main trie reached by the ordered
+ * visit of a companion trie, by increasing rank.
+ *
+ * Keys matching the query only within their trailing reference
+ * are skipped. Optionally, keys are taken as the suffixes of
+ * the folded suggestions starting a word (see
+ * for_each_word_start()), and a leaf is only reached through
+ * the first of its words matching the query: this way, each
+ * one is reached once without recording the leaves seen.
+ */
+template<typename Node>
+class CompanionLeavesIterator
+{
+public:
+
+  /**
+   * Restart from a visit of the companion @p trie to be seeded
+   * by means of visit(), matching a query of @p query_size
+   * bytes. Leaves are resolved through @p ancestors against
+   * the main trie rooted at @p root and stored in [@p base,
+   * @p end).
+   */
+  void reset (const CompanionTrie      &trie,
+	      const CompanionTrie      &ancestors,
+	      const Node               &root,
+	      const std::uint8_t       *base,
+	      const std::uint8_t       *end,
+	      const std::size_t         query_size,
+	      const bool                word_starts)
+  {
+    m_visit.reset ();
+    m_trie = trie;
+    m_ancestors = ancestors;
+    m_root = root;
+    m_base = base;
+    m_end = end;
+    m_query_size = query_size;
+    m_word_starts = word_starts;
+  }
+
+  /**
+   * Visit of the companion trie
+   */
+  OrderedLeavesIterator<Node>& visit ()
+  {
+    return m_visit;
+  }
+
+  /**
+   * Move to the first leaf once visit() is seeded
+   */
+  void start ()
+  {
+    settle ();
+  }
+
+  operator bool () const
+  {
+    return m_visit;
+  }
+
+  auto operator* () const -> const Node&
+  {
+    return m_leaf;
+  }
+
+  auto operator-> () const -> const Node*
+  {
+    return &m_leaf;
+  }
+
+  void operator++ ()
+  {
+    ++m_visit;
+    settle ();
+  }
+
+  /**
+   * Append to @p output the string spelled by current leaf
+   */
+  template<typename String>
+  void write_string (String &output) const
+  {
+    for (const auto &node : m_chain)
+    {
+      output.append (node.label_begin (),
+		     node.label_begin () + node.label_size ());
+    }
+  }
+
+private:
+
+  void settle ();
+
+  /*
+   * Fill m_chain with the nodes from the root (excluded) to
+   * the leaf of given reference
+   */
+  void resolve (const std::uint64_t reference);
+
+  /*
+   * Whether current key is the first word start of its
+   * suggestion matching the query
+   */
+  bool first_word_start ();
+
+  std::uint64_t field (const std::uint8_t *p) const
+  {
+    std::uint64_t result = 0;
+
+    for (const auto *last = p + m_ancestors.width; p != last; ++p)
+    {
+      result = (result << 8) | *p;
+    }
+
+    return result;
+  }
+
+  OrderedLeavesIterator<Node> m_visit;
+  std::string m_key;
+  std::string m_folded;
+  std::vector<Node> m_chain;
+  Node m_leaf;
+
+  CompanionTrie m_trie;
+  CompanionTrie m_ancestors;
+  Node m_root;
+  const std::uint8_t *m_base = nullptr;
+  const std::uint8_t *m_end = nullptr;
+  std::size_t m_query_size = 0;
+  bool m_word_starts = false;
+};
+
+/***********************************************************
+ *
+ * ordered_trie_companion.hpp - Inlined implementation
+ *
+ ***********************************************************/
+
+template<typename Node>
+void CompanionLeavesIterator<Node>::settle ()
+{
+  for (; m_visit; ++m_visit)
+  {
+    m_key.clear ();
+    m_visit.write_string (m_visit.path (), *m_visit, m_key);
+
+    if (m_key.size () < m_query_size + m_trie.width)
+    {
+      continue;
+    }
+
+    std::uint64_t reference = 0;
+
+    for (auto it = m_key.end () - m_trie.width; it != m_key.end (); ++it)
+    {
+      reference = (reference << 8) | static_cast<std::uint8_t> (*it);
+    }
+
+    resolve (reference);
+
+    if (m_word_starts && !first_word_start ())
+    {
+      continue;
+    }
+
+    const auto *data = m_chain.empty () ?
+      m_root.data () : m_chain.back ().data ();
+
+    const auto rank = m_visit->rank ();
+    m_leaf = Node {data, rank - Node {data, 0u, m_base}.rank (), m_base};
+    return;
+  }
+}
+
+/***********************************************************/
+
+template<typename Node>
+void CompanionLeavesIterator<Node>::resolve (const std::uint64_t reference)
+{
+  const auto trie_size = static_cast<std::uint64_t> (m_end - m_base);
+
+  m_chain.clear ();
+
+  const auto entry_size = 2 * m_ancestors.width;
+  const auto count = static_cast<std::uint64_t> (
+    m_ancestors.last - m_ancestors.first) / entry_size;
+
+  /*
+   * Parents come first, which bounds the walk
+   */
+  for (auto index = reference; ; )
+  {
+    if (index >= count)
+    {
+      throw std::runtime_error ("Invalid companion trie reference");
+    }
+
+    const auto *entry = m_ancestors.first + index * entry_size;
+    const auto offset = field (entry);
+    const auto parent = field (entry + m_ancestors.width);
+
+    if ((offset >= trie_size) || (parent > index))
+    {
+      throw std::runtime_error ("Invalid companion ancestors table");
+    }
+
+    if (parent == 0)
+    {
+      break;
+    }
+
+    m_chain.emplace_back (m_base + offset, 0u, m_base);
+    index = parent - 1;
+  }
+
+  std::reverse (m_chain.begin (), m_chain.end ());
+}
+
+/***********************************************************/
+
+template<typename Node>
+bool CompanionLeavesIterator<Node>::first_word_start ()
+{
+  m_folded.clear ();
+  write_string (m_folded);
+  fold_ascii_case (m_folded);
+
+  const auto suffix_size = m_key.size () - m_trie.width;
+
+  if (suffix_size > m_folded.size ())
+  {
+    throw std::runtime_error ("Invalid companion trie key");
+  }
+
+  const auto start = m_folded.size () - suffix_size;
+  auto first = m_folded.size ();
+
+  for_each_word_start (m_folded, [&] (const std::size_t j)
+  {
+    if ((j < first) &&
+	(m_folded.compare (j, m_query_size, m_key, 0, m_query_size) == 0))
+    {
+      first = j;
+    }
+  });
+
+  return first == start;
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
@@ -0,0 +1,309 @@
+/**
+ * @file  detail/ordered_trie_coroutine.hpp
+ * @brief Interleaved lookups written as C++20 coroutines.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_COROUTINE_HPP
+#define DETAIL_ORDERED_TRIE_COROUTINE_HPP
+
+#if defined (__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#define ORDERED_TRIE_HAS_COROUTINES 1
+#else
+#define ORDERED_TRIE_HAS_COROUTINES 0
+#endif
+
+#if ORDERED_TRIE_HAS_COROUTINES
+
+#include "ordered_trie_iterator.hpp"
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <utility>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/**
+ * Coroutine running a lookup, suspended each time it requests
+ * memory it is about to read. It starts suspended.
+ */
+class LookupTask
+{
+public:
+
+  struct promise_type
+  {
+    LookupTask get_return_object ()
+    {
+      return LookupTask {Handle::from_promise (*this)};
+    }
+
+    std::suspend_always initial_suspend () noexcept
+    {
+      return {};
+    }
+
+    std::suspend_always final_suspend () noexcept
+    {
+      return {};
+    }
+
+    void return_void ()
+    {
+    }
+
+    void unhandled_exception ()
+    {
+      exception = std::current_exception ();
+    }
+
+    std::exception_ptr exception;
+  };
+
+  using Handle = std::coroutine_handle<promise_type>;
+
+  LookupTask () = default;
+
+  LookupTask (LookupTask &&other) noexcept
+    : m_handle (std::exchange (other.m_handle, nullptr))
+  {
+  }
+
+  LookupTask& operator= (LookupTask &&other) noexcept
+  {
+    std::swap (m_handle, other.m_handle);
+    return *this;
+  }
+
+  ~LookupTask ()
+  {
+    if (m_handle)
+    {
+      m_handle.destroy ();
+    }
+  }
+
+  /**
+   * Run up to the next suspension. Returns whether the lookup
+   * is over, rethrowing the exception it raised if any.
+   */
+  bool resume ()
+  {
+    m_handle.resume ();
+
+    if (!m_handle.done ())
+    {
+      return false;
+    }
+
+    if (m_handle.promise ().exception)
+    {
+      std::rethrow_exception (m_handle.promise ().exception);
+    }
+
+    return true;
+  }
+
+private:
+
+  explicit LookupTask (const Handle handle)
+    : m_handle (handle)
+  {
+  }
+
+  Handle m_handle = nullptr;
+};
+
+/**
+ * Awaitable prefetching the sibling headers at @p address
+ * before suspending, so that other lookups run while they are
+ * loaded. The headers of wide sibling groups span a couple of
+ * cache lines.
+ */
+struct Prefetch
+{
+  const void *address;
+
+  bool await_ready () const noexcept
+  {
+    return false;
+  }
+
+  void await_suspend (std::coroutine_handle<>) const noexcept
+  {
+#if defined (__GNUC__)
+    __builtin_prefetch (address);
+    __builtin_prefetch (static_cast<const char*> (address) + 64);
+#endif
+  }
+
+  void await_resume () const noexcept
+  {
+  }
+};
+
+/**
+ * Outcome of a descent: the node it succeeded on and the
+ * number of key bytes spelled by the ancestors of such node
+ */
+template<typename Node>
+struct DescentResult
+{
+  Node locus;
+  std::size_t depth = 0;
+  bool found = false;
+};
+
+/**
+ * Descend from @p root along [@p first, @p last) into @p result
+ * as Descent does, suspending before scanning the children of
+ * each node.
+ */
+template<typename Node, typename FwdIt>
+LookupTask descend (const Node           root,
+		    FwdIt                first,
+		    const FwdIt          last,
+		    const bool           exact,
+		    DescentResult<Node> &result)
+{
+  auto locus = root;
+  std::size_t consumed = 0;
+
+  while (first != last)
+  {
+    if (locus.is_leaf ())
+    {
+      co_return;
+    }
+
+    /*
+     * The children of the root stay in cache
+     */
+    if (!(locus == root))
+    {
+      co_await Prefetch {locus.first_child ()};
+    }
+
+    const auto byte = static_cast<std::uint8_t> (*first);
+
+    auto children_it = find_sibling (
+      visit_children (locus), [byte] (const Node &node)
+      {
+	return node.label_size () && (*node.label_begin () == byte);
+      });
+
+    if (!children_it)
+    {
+      co_return;
+    }
+
+    locus = *children_it;
+    result.depth = consumed;
+
+    const auto *label_ptr = locus.label_begin ();
+    const auto *label_end = label_ptr + locus.label_size ();
+
+    for (; (label_ptr != label_end) && (first != last);
+	 ++label_ptr, ++first, ++consumed)
+    {
+      if (static_cast<std::uint8_t> (*first) != *label_ptr)
+      {
+	co_return;
+      }
+    }
+
+    if (label_ptr != label_end)
+    {
+      result.locus = locus;
+      result.found = !exact;
+      co_return;
+    }
+  }
+
+  if (!exact || locus.is_leaf ())
+  {
+    result.locus = locus;
+    result.found = !exact || !(locus == root);
+    co_return;
+  }
+
+  co_await Prefetch {locus.first_child ()};
+
+  auto leaf_it = find_sibling (
+    visit_children (locus),
+    [] (const Node &node)
+    {
+      return node.is_leaf () && !node.label_size ();
+    });
+
+  if (leaf_it)
+  {
+    result.locus = *leaf_it;
+    result.found = true;
+  }
+}
+
+/**
+ * Run the @p count lookups started by @p make_task (j),
+ * resuming up to @p group_size of them in round robin and
+ * starting a new one as soon as another is over. Calls
+ * @p on_done (j) for each lookup, in no particular order.
+ */
+template<typename MakeTask, typename F>
+void interleave_tasks (const std::size_t   count,
+		       const std::size_t   group_size,
+		       MakeTask          &&make_task,
+		       F                 &&on_done)
+{
+  std::vector<std::pair<LookupTask, std::size_t>> group;
+  group.reserve (group_size);
+
+  std::size_t next = 0;
+
+  while ((group.size () < group_size) && (next < count))
+  {
+    group.emplace_back (make_task (next), next);
+    ++next;
+  }
+
+  while (!group.empty ())
+  {
+    for (std::size_t j = 0; j < group.size ();)
+    {
+      auto &entry = group[j];
+
+      if (!entry.first.resume ())
+      {
+	++j;
+	continue;
+      }
+
+      on_done (entry.second);
+
+      if (next < count)
+      {
+	entry = std::make_pair (make_task (next), next);
+	++next;
+	++j;
+      }
+      else
+      {
+	entry = std::move (group.back ());
+	group.pop_back ();
+      }
+    }
+  }
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif // ORDERED_TRIE_HAS_COROUTINES
+
+#endif
@@ -0,0 +1,353 @@
+/**
+ * @file  detail/ordered_trie_filter.hpp
+ * @brief Blocked Bloom filter rejecting most missing keys
+ *        before descending the trie.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_FILTER_HPP
+#define DETAIL_ORDERED_TRIE_FILTER_HPP
+
+#include "ordered_trie_builtin_serialise.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/*
+ * The filter holds the suggestions and, optionally, their
+ * prefixes up to a given length, hashed apart. Each key sets
+ * a few bits of one block of 512 bits, so that a lookup reads
+ * a single block, i.e. one or two cache lines.
+ *
+ * It is stored as a sequence of 64 bit words:
+ *
+ * @code
+ * {
+ *    block_count   : word;
+ *    probes        : word;   // bits set per key
+ *    prefix_length : word;   // 0 if prefixes are absent
+ *    blocks        : word[8 * block_count];
+ * };
+ * @endcode
+ */
+
+/**
+ * Domains of the keys hashed in the filter
+ */
+enum FilterDomain : std::uint64_t
+{
+  FILTER_SUGGESTIONS = 0,
+  FILTER_PREFIXES    = 1
+};
+
+/**
+ * Hash of the bytes [@p first, @p last) in @p domain
+ */
+template<typename FwdIt>
+std::uint64_t filter_hash (FwdIt               first,
+			   const FwdIt         last,
+			   const std::uint64_t domain)
+{
+  std::uint64_t h = 0xcbf29ce484222325ull ^ (domain * 0x9e3779b97f4a7c15ull);
+
+  for (; first != last; ++first)
+  {
+    h ^= static_cast<std::uint8_t> (*first);
+    h *= 0x100000001b3ull;
+  }
+
+  /*
+   * Murmur3 finaliser, spreading the entropy over all bits
+   */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+
+  return h;
+}
+
+/**
+ * Read-only view over a filter segment. An absent filter
+ * accepts every key.
+ */
+class BloomFilter
+{
+public:
+
+  static constexpr std::size_t block_words = 8;
+  static constexpr std::size_t header_words = 3;
+  static constexpr std::size_t max_probes = 7;
+
+  /**
+   * No filter
+   */
+  BloomFilter () = default;
+
+  /**
+   * Segment serialised in [@p first, @p last). Throws
+   * std::runtime_error on inconsistent serialisation.
+   */
+  BloomFilter (const std::uint8_t *first, const std::uint8_t *last);
+
+  bool empty () const
+  {
+    return m_block_count == 0;
+  }
+
+  /**
+   * Whether some suggestion may be equal to [@p first, @p last)
+   */
+  template<typename FwdIt>
+  bool may_contain (FwdIt first, const FwdIt last) const
+  {
+    return empty () ||
+      test (filter_hash (first, last, FILTER_SUGGESTIONS));
+  }
+
+  /**
+   * Whether some suggestion may start with [@p first, @p last)
+   */
+  template<typename FwdIt>
+  bool may_start (FwdIt first, const FwdIt last) const;
+
+  /**
+   * Second hash of a key of hash @p h, whose successive 9 bit
+   * slices pick the bits it sets in its block
+   */
+  static std::uint64_t probe_bits (const std::uint64_t h)
+  {
+    const auto g = h * 0x9e3779b97f4a7c15ull;
+    return g ^ (g >> 29);
+  }
+
+private:
+
+  static constexpr std::size_t word_size = sizeof (std::uint64_t);
+
+  std::uint64_t word (const std::size_t j) const
+  {
+    return ordered_trie::deserialise<std::uint64_t> (
+      m_first + j * word_size);
+  }
+
+  bool test (const std::uint64_t h) const;
+
+  const std::uint8_t *m_first = nullptr;
+  std::uint64_t m_block_count = 0;
+  std::uint64_t m_probes = 0;
+  std::uint64_t m_prefix_length = 0;
+};
+
+/**
+ * Serialise the filter over the suggestion strings of
+ * @p suggestions, sorted as the input of the trie, and over
+ * their prefixes up to @p prefix_length bytes (if not 0), with
+ * about @p bits_per_key bits per key. Returns an empty segment
+ * if @p bits_per_key is 0.
+ */
+template<typename FwdRange>
+std::vector<std::uint8_t> make_filter_segment (
+  const FwdRange    &suggestions,
+  const std::size_t  bits_per_key,
+  const std::size_t  prefix_length);
+
+/***********************************************************
+ *
+ * ordered_trie_filter.hpp - Inlined implementation
+ *
+ ***********************************************************/
+
+inline BloomFilter::BloomFilter (const std::uint8_t *first,
+				 const std::uint8_t *last)
+  : m_first (first)
+{
+  if (first == last)
+  {
+    return;
+  }
+
+  const auto size = static_cast<std::uint64_t> (last - first);
+
+  if (size < header_words * word_size)
+  {
+    throw std::runtime_error ("Invalid filter segment size");
+  }
+
+  const auto block_count = word (0);
+  const auto probes = word (1);
+
+  if ((block_count == 0) ||
+      (block_count != (size / word_size - header_words) / block_words) ||
+      (size != (header_words + block_words * block_count) * word_size) ||
+      (probes == 0) || (probes > max_probes))
+  {
+    throw std::runtime_error ("Invalid filter segment");
+  }
+
+  m_block_count = block_count;
+  m_probes = probes;
+  m_prefix_length = word (2);
+}
+
+/***********************************************************/
+
+template<typename FwdIt>
+bool BloomFilter::may_start (FwdIt first, const FwdIt last) const
+{
+  if (empty () || (m_prefix_length == 0) || (first == last))
+  {
+    return true;
+  }
+
+  /*
+   * Longer prefixes are checked by their leading bytes
+   */
+  auto prefix_last = first;
+
+  for (std::uint64_t j = 0; (j < m_prefix_length) && (prefix_last != last);
+       ++j, ++prefix_last)
+  {
+  }
+
+  return test (filter_hash (first, prefix_last, FILTER_PREFIXES));
+}
+
+/***********************************************************/
+
+inline bool BloomFilter::test (const std::uint64_t h) const
+{
+  const auto *block = m_first +
+    (header_words + block_words * (h % m_block_count)) * word_size;
+
+  auto g = probe_bits (h);
+
+  for (std::uint64_t j = 0; j < m_probes; ++j, g >>= 9)
+  {
+    const auto bit = g & 511u;
+
+    const auto w = ordered_trie::deserialise<std::uint64_t> (
+      block + (bit >> 6) * word_size);
+
+    if (!(w & (std::uint64_t {1} << (bit & 63u))))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/***********************************************************/
+
+template<typename FwdRange>
+std::vector<std::uint8_t> make_filter_segment (
+  const FwdRange    &suggestions,
+  const std::size_t  bits_per_key,
+  const std::size_t  prefix_length)
+{
+  std::vector<std::uint8_t> result;
+
+  if (bits_per_key == 0)
+  {
+    return result;
+  }
+
+  /*
+   * Visit the keys: sorted input shares with the previous
+   * suggestion the prefixes up to their common one, which are
+   * hashed once.
+   */
+  const auto for_each_key = [&] (auto &&f)
+  {
+    std::string previous;
+    std::string s;
+
+    for (const auto &suggestion : suggestions)
+    {
+      s.assign (std::begin (suggestion.first), std::end (suggestion.first));
+      f (s.begin (), s.end (), FILTER_SUGGESTIONS);
+
+      const auto common = static_cast<std::size_t> (
+	std::mismatch (
+	  s.begin (),
+	  s.begin () + std::min (s.size (), previous.size ()),
+	  previous.begin ()).first - s.begin ());
+
+      for (auto j = common + 1; j <= std::min (prefix_length, s.size ()); ++j)
+      {
+	f (s.begin (), s.begin () + j, FILTER_PREFIXES);
+      }
+
+      std::swap (previous, s);
+    }
+  };
+
+  std::uint64_t keys = 0;
+
+  for_each_key ([&keys] (auto, auto, std::uint64_t)
+  {
+    ++keys;
+  });
+
+  const auto block_bits = 64u * BloomFilter::block_words;
+  const std::uint64_t block_count = std::max<std::uint64_t> (
+    1, (keys * bits_per_key + block_bits - 1) / block_bits);
+
+  const auto probes = std::min<std::uint64_t> (
+    std::uint64_t {BloomFilter::max_probes},
+    std::max<std::uint64_t> (
+      1, static_cast<std::uint64_t> (std::lround (bits_per_key * 0.69))));
+
+  std::vector<std::uint64_t> blocks (BloomFilter::block_words * block_count);
+
+  for_each_key ([&] (auto first, auto last, const std::uint64_t domain)
+  {
+    const auto h = filter_hash (first, last, domain);
+    auto *block = &blocks[BloomFilter::block_words * (h % block_count)];
+
+    auto g = BloomFilter::probe_bits (h);
+
+    for (std::uint64_t j = 0; j < probes; ++j, g >>= 9)
+    {
+      const auto bit = g & 511u;
+      block[bit >> 6] |= std::uint64_t {1} << (bit & 63u);
+    }
+  });
+
+  const auto append_word = [&result] (const std::uint64_t w)
+  {
+    ordered_trie::serialise (result, w);
+  };
+
+  result.reserve ((BloomFilter::header_words + blocks.size ()) *
+		  sizeof (std::uint64_t));
+
+  append_word (block_count);
+  append_word (probes);
+  append_word (prefix_length);
+
+  for (const auto w : blocks)
+  {
+    append_word (w);
+  }
+
+  return result;
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
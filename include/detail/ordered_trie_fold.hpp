@@ -0,0 +1,100 @@
+/**
+ * @file  detail/ordered_trie_fold.hpp
+ * @brief Byte normalisation and segmentation of the keys of
+ *        secondary indices.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_FOLD_HPP
+#define DETAIL_ORDERED_TRIE_FOLD_HPP
+
+#include <cstddef>
+#include <string>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ordered_trie {
+namespace detail {
+
+/**
+ * Fold ASCII upper case letters of @p text to lower case in
+ * place, leaving any other byte unchanged. Blocks of 16 bytes
+ * are folded by SSE2 instructions where available.
+ */
+inline void fold_ascii_case (std::string &text)
+{
+  std::size_t j = 0;
+
+#if defined (__SSE2__)
+  const auto below_a = _mm_set1_epi8 ('A' - 1);
+  const auto above_z = _mm_set1_epi8 ('Z' + 1);
+  const auto shift = _mm_set1_epi8 ('a' - 'A');
+
+  for (; j + 16 <= text.size (); j += 16)
+  {
+    auto *block = reinterpret_cast<__m128i*> (&text[j]);
+    const auto bytes = _mm_loadu_si128 (block);
+
+    /*
+     * Signed comparisons leave bytes past 0x7f unchanged
+     */
+    const auto upper = _mm_and_si128 (_mm_cmpgt_epi8 (bytes, below_a),
+				      _mm_cmplt_epi8 (bytes, above_z));
+
+    _mm_storeu_si128 (
+      block, _mm_add_epi8 (bytes, _mm_and_si128 (upper, shift)));
+  }
+#endif
+
+  for (; j < text.size (); ++j)
+  {
+    if ((text[j] >= 'A') && (text[j] <= 'Z'))
+    {
+      text[j] = static_cast<char> (text[j] + ('a' - 'A'));
+    }
+  }
+}
+
+/**
+ * Whether @p c separates words, i.e. is an ASCII whitespace or
+ * punctuation byte. Bytes past 0x7f, such as those of UTF-8
+ * encoded letters, never are.
+ */
+inline bool is_word_separator (const char c)
+{
+  const auto byte = static_cast<unsigned char> (c);
+
+  return ((byte >= '\t') && (byte <= '\r')) ||
+    ((byte >= ' ') && (byte <= '/')) ||
+    ((byte >= ':') && (byte <= '@')) ||
+    ((byte >= '[') && (byte <= '`')) ||
+    ((byte >= '{') && (byte <= '~'));
+}
+
+/**
+ * Call @p f with the position of each word start in @p text,
+ * that is its beginning and any byte following a separator
+ * which is not one (see is_word_separator()).
+ */
+template<typename F>
+void for_each_word_start (const std::string &text, F &&f)
+{
+  for (std::size_t j = 0; j < text.size (); ++j)
+  {
+    if ((j == 0) ||
+	(is_word_separator (text[j - 1]) && !is_word_separator (text[j])))
+    {
+      f (j);
+    }
+  }
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
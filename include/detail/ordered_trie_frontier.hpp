@@ -0,0 +1,232 @@
+/**
+ * @file  detail/ordered_trie_frontier.hpp
+ * @brief Priority queues holding the frontier of an
+ *        ordered visit.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_FRONTIER_HPP
+#define DETAIL_ORDERED_TRIE_FRONTIER_HPP
+
+#include <boost/assert.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/*
+ * A frontier is a min-priority queue of entries providing:
+ *
+ * @code
+ *   void push (const Entry&);
+ *   const Entry& top () const;
+ *   void pop ();
+ *   bool empty () const;
+ *   void clear ();  // retaining allocated storage
+ *   void for_each (F&&) const; // visit entries in any order
+ * @endcode
+ *
+ * where Entry exposes an unsigned key through rank() and
+ * operator< refining the order of entries with equal rank.
+ */
+
+/**
+ * Frontier implemented as a binary heap. Entries of equal
+ * rank are extracted in the order defined by operator<.
+ */
+template<typename Entry>
+class BinaryHeapFrontier
+{
+public:
+
+  void push (const Entry &entry)
+  {
+    m_heap.push_back (entry);
+    std::push_heap (m_heap.begin (), m_heap.end (), Greater {});
+  }
+
+  const Entry& top () const
+  {
+    return m_heap.front ();
+  }
+
+  void pop ()
+  {
+    std::pop_heap (m_heap.begin (), m_heap.end (), Greater {});
+    m_heap.pop_back ();
+  }
+
+  bool empty () const
+  {
+    return m_heap.empty ();
+  }
+
+  void clear ()
+  {
+    m_heap.clear ();
+  }
+
+  template<typename F>
+  void for_each (F &&f) const
+  {
+    std::for_each (m_heap.begin (), m_heap.end (), f);
+  }
+
+private:
+
+  struct Greater
+  {
+    bool operator () (const Entry &lhs, const Entry &rhs) const
+    {
+      return rhs < lhs;
+    }
+  };
+
+  std::vector<Entry> m_heap;
+};
+
+/**
+ * Monotone radix heap. This requires that no entry is pushed
+ * with rank lower than the last extracted one, which is the
+ * case for the ordered visit since children never rank before
+ * their parent. Push and pop take amortised O(1) time (bounded
+ * by the 64 bits of the key), while entries of equal rank are
+ * extracted in unspecified order.
+ */
+template<typename Entry>
+class RadixHeapFrontier
+{
+public:
+
+  void push (const Entry &entry)
+  {
+    const auto key = entry.rank ();
+
+    if (m_size == 0)
+    {
+      m_last = key;
+    }
+
+    BOOST_ASSERT (key >= m_last);
+    m_buckets[bucket (key)].push_back (entry);
+    ++m_size;
+  }
+
+  /*
+   * The first bucket holds the entries whose rank equals the
+   * last extracted one. It is refilled lazily, since advancing
+   * the last extracted key right after pop() would reject the
+   * entries pushed between the extraction and the next call
+   * to top().
+   */
+  const Entry& top () const
+  {
+    if (m_buckets[0].empty ())
+    {
+      refill ();
+    }
+
+    return m_buckets[0].back ();
+  }
+
+  void pop ()
+  {
+    top ();
+    m_buckets[0].pop_back ();
+    --m_size;
+  }
+
+  bool empty () const
+  {
+    return m_size == 0;
+  }
+
+  void clear ()
+  {
+    for (auto &b : m_buckets)
+    {
+      b.clear ();
+    }
+
+    m_size = 0;
+  }
+
+  template<typename F>
+  void for_each (F &&f) const
+  {
+    for (const auto &b : m_buckets)
+    {
+      std::for_each (b.begin (), b.end (), f);
+    }
+  }
+
+private:
+
+  static constexpr std::size_t key_bits = 64;
+
+  /*
+   * Number of significant bits of the difference between
+   * @p key and the last extracted key
+   */
+  std::size_t bucket (const std::uint64_t key) const
+  {
+    const auto diff = key ^ m_last;
+
+#if defined (__GNUC__)
+    return diff ? (key_bits - __builtin_clzll (diff)) : 0;
+#else
+    std::size_t result = 0;
+
+    for (auto d = diff; d; d >>= 1)
+    {
+      ++result;
+    }
+
+    return result;
+#endif
+  }
+
+  /*
+   * Move the entries of the first non empty bucket to lower
+   * buckets after updating the last extracted key to their
+   * minimum.
+   */
+  void refill () const
+  {
+    auto source = std::find_if (
+      m_buckets.begin () + 1, m_buckets.end (),
+      [] (const std::vector<Entry> &b) {return !b.empty ();});
+
+    BOOST_ASSERT (source != m_buckets.end ());
+
+    m_last = std::min_element (
+      source->begin (), source->end (),
+      [] (const Entry &lhs, const Entry &rhs)
+      {
+	return lhs.rank () < rhs.rank ();
+      })->rank ();
+
+    for (const auto &entry : *source)
+    {
+      m_buckets[bucket (entry.rank ())].push_back (entry);
+    }
+
+    source->clear ();
+  }
+
+  mutable std::array<std::vector<Entry>, key_bits + 1> m_buckets;
+  mutable std::uint64_t m_last = 0;
+  std::size_t m_size = 0;
+};
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
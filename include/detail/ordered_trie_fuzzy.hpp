@@ -0,0 +1,159 @@
+/**
+ * @file  detail/ordered_trie_fuzzy.hpp
+ * @brief Approximate prefix matching within bounded edit
+ *        distance.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_FUZZY_HPP
+#define DETAIL_ORDERED_TRIE_FUZZY_HPP
+
+#include "ordered_trie_iterator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/**
+ * Find the topmost nodes spelling a string within @p max_edits
+ * Levenshtein edits from [@p first, @p last), whose subtries
+ * hold all the strings having a prefix within such distance.
+ *
+ * The trie is visited depth first carrying the row of the edit
+ * distance matrix between the query and the string spelled so
+ * far, updated once per label byte. Subtries are pruned as soon
+ * as every entry of the row exceeds the budget.
+ *
+ * Returns the matching nodes paired with the chain of labels
+ * leading to them, built by mean of @p visitor.
+ */
+template<typename Node, typename Visitor, typename FwdIt>
+auto fuzzy_prefix_loci (const Node        &root,
+			FwdIt              first,
+			const FwdIt        last,
+			const std::size_t  max_edits,
+			Visitor           &visitor)
+  -> std::vector<std::pair<Node, std::size_t>>
+{
+  const std::vector<std::uint8_t> query (first, last);
+  const auto width = query.size () + 1;
+
+  std::vector<std::pair<Node, std::size_t>> result;
+
+  if (query.size () <= max_edits)
+  {
+    result.emplace_back (root, visitor.no_link);
+    return result;
+  }
+
+  if (root.is_leaf ())
+  {
+    return result;
+  }
+
+  /*
+   * Rows arena: each frame refers to the row of the string
+   * leading to its children.
+   */
+  std::vector<std::size_t> rows (width);
+  std::iota (rows.begin (), rows.end (), 0u);
+
+  struct Frame
+  {
+    SiblingsIterator<Node> children;
+    std::size_t path;
+    std::size_t row;
+  };
+
+  std::vector<Frame> stack {{visit_children (root), visitor.no_link, 0}};
+
+  while (!stack.empty ())
+  {
+    auto &top = stack.back ();
+
+    if (!top.children)
+    {
+      rows.resize (top.row);
+      stack.pop_back ();
+      continue;
+    }
+
+    const auto node = *top.children;
+    const auto path = top.path;
+    const auto parent_row = top.row;
+    ++top.children;
+
+    const auto row = rows.size ();
+    rows.resize (row + width);
+
+    std::copy (rows.begin () + parent_row,
+	       rows.begin () + parent_row + width,
+	       rows.begin () + row);
+
+    auto *r = rows.data () + row;
+    bool matched = false;
+    bool pruned = false;
+
+    for (auto label = node.label_begin ();
+	 label != node.label_begin () + node.label_size ();
+	 ++label)
+    {
+      auto diagonal = r[0];
+      ++r[0];
+      auto best = r[0];
+
+      for (std::size_t i = 1; i < width; ++i)
+      {
+	const auto above = r[i];
+
+	r[i] = std::min ({above + 1,
+			  r[i - 1] + 1,
+			  diagonal + (query[i - 1] != *label)});
+
+	diagonal = above;
+	best = std::min (best, r[i]);
+      }
+
+      if (r[width - 1] <= max_edits)
+      {
+	matched = true;
+	break;
+      }
+
+      if (best > max_edits)
+      {
+	pruned = true;
+	break;
+      }
+    }
+
+    if (matched)
+    {
+      result.emplace_back (node, path);
+    }
+    else if (!pruned && !node.is_leaf ())
+    {
+      stack.push_back ({visit_children (node),
+			visitor.append_link (node, path),
+			row});
+      continue;
+    }
+
+    rows.resize (row);
+  }
+
+  return result;
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
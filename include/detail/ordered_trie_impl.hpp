@@ -14,7 +14,12 @@
 
 #include <boost/assert.hpp>
 
+#include <algorithm>
 #include <limits>
+#include <mutex>
+#include <queue>
+#include <type_traits>
+#include <vector>
 
 namespace ordered_trie {
 namespace detail {
@@ -44,10 +49,18 @@ auto make_empty_trie ()
 
 /***********************************************************/
 
-template<typename Node, typename FwdIt>
-Node prefix_match (Node  locus,
-		   FwdIt &first,
-		   const FwdIt last)
+/**
+ * Descend from @p locus along the path spelling the longest
+ * matching prefix of [@p first, @p last), advancing @p first
+ * past it. Returns last node reached, calling @p on_descend
+ * on each node the descent moves away from together with the
+ * siblings iterator pointing to the child it moves to.
+ */
+template<typename Node, typename FwdIt, typename F>
+Node prefix_match (Node         locus,
+		   FwdIt       &first,
+		   const FwdIt  last,
+		   F          &&on_descend)
 {
   while (first != last)
   {
@@ -55,11 +68,12 @@ Node prefix_match (Node  locus,
       visit_children (locus), [&first] (const Node &node)
       {
   	return node.label_size () &&
-     	       *node.label_begin () == *first;
+     	       *node.label_begin () == static_cast<std::uint8_t> (*first);
       });
 
     if (children_it)
     {
+      on_descend (locus, children_it);
       locus = *children_it;
       const auto *label_ptr = children_it->label_begin() + 1;
       const auto *label_end = children_it->label_begin() +
@@ -68,7 +82,7 @@ Node prefix_match (Node  locus,
 
       while ((label_ptr != label_end) && (first != last))
       {
-	if (*first != *label_ptr)
+	if (static_cast<std::uint8_t> (*first) != *label_ptr)
 	{
 	  return locus; 
 	}
@@ -88,6 +102,86 @@ Node prefix_match (Node  locus,
 
 /***********************************************************/
 
+template<typename Node, typename FwdIt>
+Node prefix_match (Node  locus,
+		   FwdIt &first,
+		   const FwdIt last)
+{
+  return prefix_match (
+    locus, first, last,
+    [] (const Node&, const SiblingsIterator<Node>&) {});
+}
+
+/***********************************************************/
+
+/**
+ * End of the subtrie rooted at the child of @p parent pointed
+ * by @p child, given the end @p parent_end of the subtrie
+ * rooted at @p parent (see SubtreeAnnotation).
+ */
+template<typename Node>
+const std::uint8_t *child_subtree_end (
+  const Node             &parent,
+  const std::uint8_t     *parent_end,
+  SiblingsIterator<Node>  child,
+  const std::uint64_t     annotations)
+{
+  ++child;
+
+  if (child)
+  {
+    return child->first_child ();
+  }
+
+  read_subtree_summary (parent, parent_end, annotations);
+  return parent_end;
+}
+
+/***********************************************************/
+
+/**
+ * Summarise the leaves of subtrie rooted at @p node by
+ * visiting it, for tries lacking annotations.
+ */
+template<typename Node>
+SubtreeSummary visit_subtree_summary (const Node &node)
+{
+  SubtreeSummary result;
+  result.min_rank = std::numeric_limits<std::uint64_t>::max ();
+
+  std::vector<SiblingsIterator<Node>> pending
+  {
+    SiblingsIterator<Node> {node, Node::skip (node.data ())}
+  };
+
+  while (!pending.empty ())
+  {
+    if (!pending.back ())
+    {
+      pending.pop_back ();
+      continue;
+    }
+
+    const auto current = *pending.back ();
+    ++pending.back ();
+
+    if (current.is_leaf ())
+    {
+      ++result.leaf_count;
+      result.min_rank = std::min (result.min_rank, current.rank ());
+      result.max_rank = std::max (result.max_rank, current.rank ());
+    }
+    else
+    {
+      pending.push_back (visit_children (current));
+    }
+  }
+
+  return result;
+}
+
+/***********************************************************/
+
 template<typename Node, typename FwdIt>
 bool find_leaf (Node &locus,
 		FwdIt first,
@@ -99,7 +193,7 @@ bool find_leaf (Node &locus,
       visit_children (locus), [&first] (const Node &node)
       {
   	return node.label_size () &&
-     	       *node.label_begin () == *first;
+     	       *node.label_begin () == static_cast<std::uint8_t> (*first);
       });
     
     if (children_it)
@@ -112,7 +206,7 @@ bool find_leaf (Node &locus,
 
       while ((label_ptr != label_end) && (first != last))
       {
-	if (*first != *label_ptr)
+	if (static_cast<std::uint8_t> (*first) != *label_ptr)
 	{
 	  return false; 
 	}
@@ -153,6 +247,142 @@ bool find_leaf (Node &locus,
   return false;
 }
 
+/***********************************************************/
+
+/**
+ * Whether scores are encoded in sizeof (Score) bytes, as by the
+ * built-in serialisation of arithmetic types. Tables of scores
+ * otherwise serialised are walked by means of skip().
+ */
+template<typename Score>
+using FixedSizeScores = std::integral_constant<
+  bool,
+  std::conditional_t<
+    std::is_arithmetic<Score>::value,
+    std::is_base_of<SerialiseArithmetic<Score>, Serialise<Score>>,
+    std::false_type>::value>;
+
+/***********************************************************/
+
+/**
+ * Rank of the last score in table [@p first, @p last), sorted
+ * by @p cmp, not ranked after @p score, or none if there is no
+ * such score. Table entries have fixed size if @p fixed_size.
+ */
+template<typename Score, typename Cmp>
+boost::optional<std::uint64_t>
+score_rank_bound (const std::uint8_t *first,
+		  const std::uint8_t *last,
+		  const Score        &score,
+		  const Cmp          &cmp,
+		  std::true_type      fixed_size)
+{
+  const auto size = static_cast<std::size_t> (last - first) /
+                    sizeof (Score);
+
+  std::size_t lo = 0;
+  std::size_t hi = size;
+
+  while (lo < hi)
+  {
+    const auto mid = lo + (hi - lo) / 2;
+
+    if (cmp (score, deserialise<Score> (first + mid * sizeof (Score))))
+    {
+      hi = mid;
+    }
+    else
+    {
+      lo = mid + 1;
+    }
+  }
+
+  if (lo == 0)
+  {
+    return boost::none;
+  }
+
+  return static_cast<std::uint64_t> ((lo - 1) * sizeof (Score));
+}
+
+/***********************************************************/
+
+template<typename Score, typename Cmp>
+boost::optional<std::uint64_t>
+score_rank_bound (const std::uint8_t *first,
+		  const std::uint8_t *last,
+		  const Score        &score,
+		  const Cmp          &cmp,
+		  std::false_type     fixed_size)
+{
+  boost::optional<std::uint64_t> result;
+
+  for (auto p = first;
+       (p < last) && !cmp (score, deserialise<Score> (p));
+       p = Serialise<Score>::skip (p))
+  {
+    result = static_cast<std::uint64_t> (p - first);
+  }
+
+  return result;
+}
+
+/***********************************************************/
+
+/**
+ * Whether no score of table [@p first, @p last) is ranked by
+ * @p cmp before the previous one. Table entries have fixed
+ * size if @p fixed_size.
+ */
+template<typename Score, typename Cmp>
+bool score_table_sorted (const std::uint8_t *first,
+			 const std::uint8_t *last,
+			 const Cmp          &cmp,
+			 std::true_type      fixed_size)
+{
+  for (auto p = first; p + 2 * sizeof (Score) <= last; p += sizeof (Score))
+  {
+    if (cmp (deserialise<Score> (p + sizeof (Score)), deserialise<Score> (p)))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/***********************************************************/
+
+template<typename Score, typename Cmp>
+bool score_table_sorted (const std::uint8_t *first,
+			 const std::uint8_t *last,
+			 const Cmp          &cmp,
+			 std::false_type     fixed_size)
+{
+  if (first == last)
+  {
+    return true;
+  }
+
+  auto previous = deserialise<Score> (first);
+
+  for (auto p = Serialise<Score>::skip (first);
+       p < last;
+       p = Serialise<Score>::skip (p))
+  {
+    auto score = deserialise<Score> (p);
+
+    if (cmp (score, previous))
+    {
+      return false;
+    }
+
+    previous = std::move (score);
+  }
+
+  return true;
+}
+
 } // namespace detail {
 
 /***************************************************/
@@ -231,14 +461,37 @@ public:
       , m_trie {&owner}
   {
   }
+
+  /**
+   * Serialised state of the enumeration, allowing to resume
+   * it from current element by mean of OrderedTrie::resume().
+   */
+  std::string cursor () const
+  {
+    return m_trie->save_cursor (m_visitor);
+  }
+
+  /**
+   * True if the enumeration was stopped by the bounds passed
+   * to complete() before exhausting the completions.
+   */
+  bool truncated () const
+  {
+    return m_visitor.truncated ();
+  }
   
 private:
 
   friend class boost::iterator_core_access;
+  friend class OrderedTrie<Score>;
+  friend class OrderedTrie<Score>::CompletionSession;
+  friend class OrderedTrie<Score>::PrefixCursor;
   
   OrderedTrie<Score>::value_type dereference () const
   {
-    return leaf_to_suggestion (*m_visitor);
+    typename OrderedTrie<Score>::value_type result;
+    m_trie->make_completion (m_visitor, result);
+    return result;
   }
 
   bool equal (const iterator &other) const
@@ -252,29 +505,6 @@ private:
     ++m_visitor;
   }
 
-private:
-
-  auto leaf_to_suggestion (const Node &leaf) const
-    -> typename OrderedTrie<Score>::value_type
-  {
-    typename OrderedTrie<Score>::value_type result;
-
-    detail::traverse_descending_path (
-      m_trie->m_root, leaf,
-      [&result] (const Node &n)
-      {
-	result.first.append (
-          n.label_begin (),
-	  n.label_begin () + n.label_size ());
-      });
-
-    const auto score_address =
-      m_trie->m_score_table + leaf.rank ();
-    
-    result.second = deserialise<Score> (score_address);	  
-    return result;
-  }
-  
 private:
   detail::OrderedLeavesIterator<Node> m_visitor;
   const OrderedTrie<Score> *m_trie;
@@ -282,228 +512,2685 @@ private:
   
 /***************************************************/
 /**
- * Internal template parameters passed to store layer
+ * Buffers reused across queries
  */
 template<typename Score>
-template<typename FwdIt, typename Comparer>
-OrderedTrie<Score>::
-OrderedTrie (FwdIt begin_suggestions,
-	     FwdIt end_suggestions,
-	     const Comparer &score_comparer)
+class OrderedTrie<Score>::QueryContext
 {
-  using namespace ordered_trie::detail;
+public:
 
-  const auto suggestions =
-    boost::make_iterator_range (
-      begin_suggestions,
-      end_suggestions);
+  QueryContext () = default;
 
-  std::vector<std::uint8_t> serialised_scores;
+  /**
+   * Not-copyable or assignable
+   */
+  QueryContext (const QueryContext&)            = delete;
+  QueryContext& operator= (const QueryContext&) = delete;
 
-  const auto score_map = serialise_scores (
-    serialised_scores,
-    suggestions,
-    score_comparer);
+  /**
+   * True if the last query was stopped by the bounds passed
+   * to complete() before exhausting the completions.
+   */
+  bool truncated () const
+  {
+    return m_visitor.truncated ();
+  }
 
-  auto serialised_trie =
-    make_serialised_ordered_trie (
-      suggestions,
-      [&] (const Score &score) -> std::uint64_t
-      {
-	return score_map.at (score);
-      });
+private:
+  friend class OrderedTrie<Score>;
+  friend class OrderedTrie<Score>::context_iterator;
+  friend class OrderedTrie<Score>::CompletionRef;
+  friend class OrderedTrie<Score>::ref_iterator;
 
-  m_store = Store::from_memory (
-    std::move (serialised_trie),
-    std::move (serialised_scores));
-  
-  m_score_table = m_store->score_table_data ().first;
-  m_root = detail::make_trie_root (m_store->trie_data ().first);
-}
+  detail::OrderedLeavesIterator<Node> m_visitor;
+  typename OrderedTrie<Score>::value_type m_completion;
+  std::string m_string_buffer;
+  const OrderedTrie<Score> *m_trie = nullptr;
+};
 
 /***************************************************/
-
+/**
+ * Iterate over the leaves visited by a QueryContext, 
+ * refreshing in place the completion object it hosts.
+ */
 template<typename Score>
-template<typename FwdIt>
-OrderedTrie<Score>::
-OrderedTrie (FwdIt begin_suggestions,
-	     FwdIt end_suggestions)
-  : OrderedTrie<Score> (begin_suggestions,
-                        end_suggestions,
-			std::greater<Score> {})
+class OrderedTrie<Score>::context_iterator
+  : public boost::iterator_facade< 
+     /* CRTP       */ typename OrderedTrie<Score>::context_iterator,
+     /* value_type */ typename OrderedTrie<Score>::value_type,
+     /* category   */ boost::single_pass_traversal_tag,
+     /* reference  */ const typename OrderedTrie<Score>::value_type&>
 {
-}
-
-/***************************************************/
+public:
 
-template<typename Score>
-OrderedTrie<Score>::
-OrderedTrie (const std::initializer_list<value_type> &values)
-  : OrderedTrie<Score> (values.begin (),
-			values.end ())
-{
-}
+  explicit context_iterator ()
+    : m_context {nullptr}
+  {
+  }
 
-/***************************************************/
+  explicit context_iterator (QueryContext &context)
+    : m_context {&context}
+  {
+  }
 
-template<typename Score>
-template<typename Cmp>
-OrderedTrie<Score>::
-OrderedTrie (const std::initializer_list<value_type> &values,
-	     const Cmp &comparer)
-  : OrderedTrie<Score> (values.begin (),
-			values.end (),
-			comparer)
-{
-}
+  /**
+   * Serialised state of the enumeration, allowing to resume
+   * it from current element by mean of OrderedTrie::resume().
+   * Undefined for default constructed iterators.
+   */
+  std::string cursor () const
+  {
+    BOOST_ASSERT (m_context);
+    return m_context->m_trie->save_cursor (m_context->m_visitor);
+  }
 
+private:
 
-/***************************************************/
+  friend class boost::iterator_core_access;
 
-template<typename Score>
-OrderedTrie<Score>::OrderedTrie ()
-{
-  m_store = Store::from_memory (
-    detail::make_empty_trie<Score> ());
+  auto dereference () const
+    -> const typename OrderedTrie<Score>::value_type&
+  {
+    return m_context->m_completion;
+  }
 
-  m_score_table = nullptr;
-  m_root = detail::make_trie_root (m_store->trie_data ().first);
-}
+  bool equal (const context_iterator &other) const
+  {
+    return at_end () == other.at_end ();
+  }
 
-/***************************************************/
+  void increment ()
+  {
+    ++(m_context->m_visitor);
 
-template<typename Score>
-OrderedTrie<Score>::OrderedTrie (
-  std::shared_ptr<const Store> store)
-{
-  const auto trie_data = store->trie_data ().first;
-  BOOST_ASSERT (trie_data);
+    if (m_context->m_visitor)
+    {
+      m_context->m_trie->make_completion (
+        m_context->m_visitor,
+	m_context->m_completion);
+    }
+  }
 
-  if (trie_data)
+  bool at_end () const
   {
-    m_root = detail::make_trie_root (trie_data);
-    m_score_table = store->score_table_data ().first;
-    m_store = store;
+    return !m_context || !(m_context->m_visitor);
   }
-}
 
-/***************************************************/
+private:
+  QueryContext *m_context;
+};
 
+/***************************************************/
+/**
+ * Handle to a leaf visited by a QueryContext
+ */
 template<typename Score>
-bool OrderedTrie<Score>::empty () const
+class OrderedTrie<Score>::CompletionRef
 {
-  return m_root.is_leaf ();
-}
-
-/***************************************************/
+public:
+
+  /**
+   * Rank of the completion, i.e. position of its score
+   * in the trie order.
+   */
+  std::uint64_t rank () const
+  {
+    return m_leaf.rank ();
+  }
+
+  /**
+   * Decode score of the completion
+   */
+  Score score () const
+  {
+    return deserialise<Score> (
+      m_context->m_trie->m_score_table + m_leaf.rank ());
+  }
+
+  /**
+   * Append completion string to @p buffer, which is required
+   * to provide resize() and end() as std::string does.
+   */
+  template<typename String>
+  void write_string (String &buffer) const
+  {
+    m_context->m_visitor.write_string (m_path, m_leaf, buffer);
+  }
+
+  /**
+   * Spell completion string into a buffer owned by the
+   * context and return a view over it. The view is invalidated
+   * by the next call to string_view() on any reference
+   * issued by the same context.
+   */
+  boost::string_ref string_view () const
+  {
+    auto &buffer = m_context->m_string_buffer;
+    buffer.clear ();
+    write_string (buffer);
+    return buffer;
+  }
+
+private:
+  friend class OrderedTrie<Score>::ref_iterator;
+
+  CompletionRef (QueryContext &context,
+		 const Node   &leaf,
+		 std::size_t   path)
+    : m_context {&context}
+    , m_leaf {leaf}
+    , m_path {path}
+  {
+  }
+
+  QueryContext *m_context;
+  Node m_leaf;
+  std::size_t m_path;
+};
+
+/***************************************************/
+/**
+ * Iterate over the leaves visited by a QueryContext
+ * returning a CompletionRef for each of them.
+ */
+template<typename Score>
+class OrderedTrie<Score>::ref_iterator
+  : public boost::iterator_facade< 
+     /* CRTP       */ typename OrderedTrie<Score>::ref_iterator,
+     /* value_type */ typename OrderedTrie<Score>::CompletionRef,
+     /* category   */ boost::single_pass_traversal_tag,
+     /* reference  */ typename OrderedTrie<Score>::CompletionRef>
+{
+public:
+
+  explicit ref_iterator ()
+    : m_context {nullptr}
+  {
+  }
+
+  explicit ref_iterator (QueryContext &context)
+    : m_context {&context}
+  {
+  }
+
+private:
+
+  friend class boost::iterator_core_access;
+
+  CompletionRef dereference () const
+  {
+    const auto &visitor = m_context->m_visitor;
+    return CompletionRef {*m_context, *visitor, visitor.path ()};
+  }
+
+  bool equal (const ref_iterator &other) const
+  {
+    return at_end () == other.at_end ();
+  }
+
+  void increment ()
+  {
+    ++(m_context->m_visitor);
+  }
+
+  bool at_end () const
+  {
+    return !m_context || !(m_context->m_visitor);
+  }
+
+private:
+  QueryContext *m_context;
+};
+
+/***************************************************/
+/**
+ * Iterate over suggestions in lexicographic order
+ */
+template<typename Score>
+class OrderedTrie<Score>::lexicographic_iterator
+  : public boost::iterator_facade< 
+     /* CRTP       */ typename OrderedTrie<Score>::lexicographic_iterator,
+     /* value_type */ typename OrderedTrie<Score>::value_type,
+     /* category   */ boost::forward_traversal_tag,
+     /* reference  */ typename OrderedTrie<Score>::value_type>
+{
+public:
+
+  using Node = typename OrderedTrie<Score>::Node;
+
+  explicit lexicographic_iterator (
+    const OrderedTrie<Score> &owner)
+      : m_visitor {}
+      , m_trie {&owner}
+  {
+  }
+
+private:
+
+  friend class boost::iterator_core_access;
+  friend class OrderedTrie<Score>;
+
+  OrderedTrie<Score>::value_type dereference () const
+  {
+    typename OrderedTrie<Score>::value_type result;
+    m_visitor.write_string (result.first);
+
+    result.second = deserialise<Score> (
+      m_trie->m_score_table + m_visitor->rank ());
+
+    return result;
+  }
+
+  bool equal (const lexicographic_iterator &other) const
+  {
+    return (m_trie == other.m_trie) &&
+           (m_visitor == other.m_visitor);
+  }
+
+  void increment ()
+  {
+    ++m_visitor;
+  }
+
+private:
+  detail::LexicographicIterator<Node> m_visitor;
+  const OrderedTrie<Score> *m_trie;
+};
+
+/***************************************************/
+/**
+ * Iterate over completions found through a companion trie
+ */
+template<typename Score>
+class OrderedTrie<Score>::companion_iterator
+  : public boost::iterator_facade< 
+     /* CRTP       */ typename OrderedTrie<Score>::companion_iterator,
+     /* value_type */ typename OrderedTrie<Score>::value_type,
+     /* category   */ boost::forward_traversal_tag,
+     /* reference  */ typename OrderedTrie<Score>::value_type>
+{
+public:
+
+  using Node = typename OrderedTrie<Score>::Node;
+
+  explicit companion_iterator (
+    const OrderedTrie<Score> &owner)
+      : m_visitor {}
+      , m_trie {&owner}
+  {
+  }
+
+private:
+
+  friend class boost::iterator_core_access;
+  friend class OrderedTrie<Score>;
+
+  OrderedTrie<Score>::value_type dereference () const
+  {
+    typename OrderedTrie<Score>::value_type result;
+    m_visitor.write_string (result.first);
+
+    result.second = deserialise<Score> (
+      m_trie->m_score_table + m_visitor->rank ());
+
+    return result;
+  }
+
+  bool equal (const companion_iterator &other) const
+  {
+    return (m_trie == other.m_trie) &&
+           (!m_visitor == !other.m_visitor);
+  }
+
+  void increment ()
+  {
+    ++m_visitor;
+  }
+
+private:
+  detail::CompanionLeavesIterator<Node> m_visitor;
+  const OrderedTrie<Score> *m_trie;
+};
+
+/***************************************************/
+/**
+ * Autocompletion session, following the prefix typed by
+ * the user. Each byte appended extends the match of the
+ * previous prefix from the node it reached, scanning at most
+ * one sibling group per byte, and the nodes entered are kept
+ * on a stack to undo it on backspace.
+ *
+ * Top completions are cached: as the top completions of a
+ * prefix which are also completions of a longer one are the
+ * top completions of the latter, the cache is filtered when
+ * the prefix grows, and only refreshed when too few survive.
+ */
+template<typename Score>
+class OrderedTrie<Score>::CompletionSession
+{
+public:
+
+  using Node = typename OrderedTrie<Score>::Node;
+  using const_iterator =
+    typename std::vector<value_type>::const_iterator;
+
+  /**
+   * Session over @p trie, starting from the empty prefix.
+   * The trie must outlive the session.
+   */
+  explicit CompletionSession (const OrderedTrie<Score> &trie)
+    : m_trie {&trie}
+    , m_nodes {trie.m_root}
+  {
+  }
+
+  /**
+   * Current prefix
+   */
+  const std::string& prefix () const
+  {
+    return m_prefix;
+  }
+
+  /**
+   * Whether some suggestion starts with current prefix
+   */
+  bool matched () const
+  {
+    return !m_trie->empty () && (m_matched == m_prefix.size ());
+  }
+
+  /**
+   * Append @p c to current prefix
+   */
+  void push_back (const char c);
+
+  /**
+   * Remove last byte of current prefix. Throws
+   * std::logic_error if empty.
+   */
+  void pop_back ();
+
+  /**
+   * Replace current prefix with @p prefix, keeping the match
+   * of their common prefix.
+   */
+  void assign (const std::string &prefix);
+
+  /**
+   * Returns range of the completions of current prefix,
+   * ordered by decreasing score.
+   */
+  auto complete () const -> boost::iterator_range<iterator>;
+
+  /**
+   * Returns the first @p k completions of current prefix,
+   * ordered by decreasing score. The range is invalidated by
+   * the next call.
+   */
+  auto top (const std::size_t k) -> boost::iterator_range<const_iterator>;
+
+private:
+
+  /*
+   * Bytes of the label of the last node entered matched by
+   * each matched byte of the prefix
+   */
+  struct Frame
+  {
+    std::uint8_t offset;
+  };
+
+  std::size_t label_offset () const
+  {
+    return m_frames.empty () ?
+      m_nodes.back ().label_size () : m_frames.back ().offset;
+  }
+
+  const OrderedTrie<Score> *m_trie;
+  std::string m_prefix;
+  std::size_t m_matched = 0;
+  std::vector<Node> m_nodes;
+  std::vector<Frame> m_frames;
+
+  detail::OrderedLeavesIterator<Node> m_visitor;
+  std::vector<value_type> m_top;
+  std::string m_top_prefix;
+  bool m_top_valid = false;
+  bool m_top_exhaustive = false;
+};
+
+/***************************************************/
+/**
+ * Cursor on a prefix of some suggestion, made of the nodes
+ * entered from the root and the number of bytes of the label
+ * of the last one matched so far.
+ */
+template<typename Score>
+class OrderedTrie<Score>::PrefixCursor
+{
+public:
+
+  using Node = typename OrderedTrie<Score>::Node;
+
+  /**
+   * Cursor on the empty prefix of @p trie, which must outlive
+   * the cursor.
+   */
+  explicit PrefixCursor (const OrderedTrie<Score> &trie)
+    : m_trie {&trie}
+    , m_nodes {trie.m_root}
+  {
+  }
+
+  /**
+   * Current prefix
+   */
+  const std::string& prefix () const
+  {
+    return m_prefix;
+  }
+
+  /**
+   * Append @p c to current prefix, if some suggestion starts
+   * with the result. Returns whether it does, leaving the
+   * cursor unchanged otherwise.
+   */
+  bool advance (const char c);
+
+  /**
+   * Advance along [@p first, @p last) as far as possible,
+   * returning an iterator past the bytes appended.
+   */
+  template<typename FwdIt>
+  FwdIt advance (FwdIt first, const FwdIt last);
+
+  /**
+   * Returns the bytes which advance() accepts, in increasing
+   * order.
+   */
+  std::string children () const;
+
+  /**
+   * Whether current prefix is a suggestion
+   */
+  bool is_terminal () const
+  {
+    return static_cast<bool> (terminal_leaf ());
+  }
+
+  /**
+   * Returns the score of current prefix. Throws
+   * std::logic_error if it is not a suggestion.
+   */
+  Score score () const;
+
+  /**
+   * Returns range of the completions of current prefix,
+   * ordered by decreasing score.
+   */
+  auto complete () const -> boost::iterator_range<iterator>;
+
+private:
+
+  auto terminal_leaf () const -> boost::optional<Node>;
+
+  const OrderedTrie<Score> *m_trie;
+  std::string m_prefix;
+  std::vector<Node> m_nodes;
+  std::size_t m_offset = 0;
+};
+
+/***************************************************/
+/**
+ * Internal template parameters passed to store layer
+ */
+template<typename Score>
+template<typename FwdIt, typename Comparer>
+OrderedTrie<Score>::
+OrderedTrie (FwdIt begin_suggestions,
+	     FwdIt end_suggestions,
+	     const Comparer &score_comparer)
+  : OrderedTrie<Score> (begin_suggestions,
+			end_suggestions,
+			score_comparer,
+			BuildOptions {})
+{
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt, typename Comparer>
+OrderedTrie<Score>::
+OrderedTrie (FwdIt               begin_suggestions,
+	     FwdIt               end_suggestions,
+	     const Comparer     &score_comparer,
+	     const BuildOptions &options)
+{
+  using namespace ordered_trie::detail;
+
+  m_rank_bound = make_rank_bound (score_comparer);
+
+  const auto suggestions =
+    boost::make_iterator_range (
+      begin_suggestions,
+      end_suggestions);
+
+  const std::uint64_t annotations =
+    (options.leaf_counts  ? SUBTREE_LEAF_COUNTS : 0) |
+    (options.score_ranges ? SUBTREE_RANK_RANGES : 0) |
+    (options.category_masks.empty () ? 0 : SUBTREE_CATEGORY_MASKS);
+
+  std::vector<std::uint8_t> serialised_scores;
+
+  const auto score_map = serialise_scores (
+    serialised_scores,
+    suggestions,
+    score_comparer);
+
+  auto serialised_trie =
+    make_serialised_ordered_trie (
+      suggestions,
+      [&] (const Score &score) -> std::uint64_t
+      {
+	return score_map.at (score);
+      },
+      annotations,
+      options.category_masks);
+
+  auto serialised_top_k =
+    make_top_k_index<OrderedLeavesIterator<Node>> (
+      make_trie_root (serialised_trie.data ()),
+      serialised_trie.data (),
+      options.top_k,
+      options.top_k_threshold);
+
+  std::vector<std::tuple<std::uint64_t,
+			 std::uint64_t,
+			 std::vector<std::uint8_t>>> companions;
+
+  const auto *trie_begin = serialised_trie.data ();
+  const auto *trie_end = trie_begin + serialised_trie.size ();
+
+  AncestorsTable ancestors;
+
+  if (options.folded_index || options.word_start_index ||
+      options.suffix_index)
+  {
+    ancestors = make_ancestors_table (
+      make_trie_root (trie_begin), trie_begin, trie_end);
+  }
+
+  if (options.folded_index)
+  {
+    companions.emplace_back (
+      COMPANION_FOLDED,
+      ancestors.width,
+      make_companion_trie (
+	make_trie_root (trie_begin), ancestors,
+	[] (const std::string &suggestion, auto &&emit)
+	{
+	  auto key = suggestion;
+	  fold_ascii_case (key);
+	  emit (std::move (key));
+	}));
+  }
+
+  if (options.word_start_index)
+  {
+    companions.emplace_back (
+      COMPANION_WORD_STARTS,
+      ancestors.width,
+      make_companion_trie (
+	make_trie_root (trie_begin), ancestors,
+	[] (const std::string &suggestion, auto &&emit)
+	{
+	  auto folded = suggestion;
+	  fold_ascii_case (folded);
+
+	  for_each_word_start (folded, [&] (const std::size_t j)
+	  {
+	    emit (folded.substr (j));
+	  });
+	}));
+  }
+
+  if (options.suffix_index)
+  {
+    companions.emplace_back (
+      COMPANION_REVERSED,
+      ancestors.width,
+      make_companion_trie (
+	make_trie_root (trie_begin), ancestors,
+	[] (const std::string &suggestion, auto &&emit)
+	{
+	  emit (std::string (suggestion.rbegin (), suggestion.rend ()));
+	}));
+  }
+
+  if (!ancestors.serialised.empty ())
+  {
+    companions.emplace_back (
+      COMPANION_ANCESTORS,
+      ancestors.width,
+      std::move (ancestors.serialised));
+  }
+
+  m_store = Store::from_memory (
+    std::move (serialised_trie),
+    std::move (serialised_scores),
+    annotations,
+    std::move (serialised_top_k),
+    make_companions_segment (companions),
+    make_filter_segment (suggestions,
+			 options.filter_bits_per_key,
+			 options.filter_prefix_length));
+  
+  m_score_table = m_store->score_table_data ().first;
+  m_root = detail::make_trie_root (m_store->trie_data ().first);
+
+  m_top_k = TopKIndex<Node>
+  {
+    m_store->top_k_data ().first,
+    m_store->top_k_data ().second,
+    m_store->trie_data ().first,
+    m_store->trie_data ().second
+  };
+
+  m_companions = CompanionDirectory
+  {
+    m_store->companions_data ().first,
+    m_store->companions_data ().second
+  };
+
+  m_filter = BloomFilter
+  {
+    m_store->filter_data ().first,
+    m_store->filter_data ().second
+  };
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+OrderedTrie<Score>::
+OrderedTrie (FwdIt begin_suggestions,
+	     FwdIt end_suggestions)
+  : OrderedTrie<Score> (begin_suggestions,
+                        end_suggestions,
+			std::greater<Score> {})
+{
+}
+
+/***************************************************/
+
+template<typename Score>
+OrderedTrie<Score>::
+OrderedTrie (const std::initializer_list<value_type> &values)
+  : OrderedTrie<Score> (values.begin (),
+			values.end ())
+{
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename Cmp>
+OrderedTrie<Score>::
+OrderedTrie (const std::initializer_list<value_type> &values,
+	     const Cmp &comparer)
+  : OrderedTrie<Score> (values.begin (),
+			values.end (),
+			comparer)
+{
+}
+
+
+/***************************************************/
+
+template<typename Score>
+OrderedTrie<Score>::OrderedTrie ()
+  : m_rank_bound {make_rank_bound (std::greater<Score> {})}
+{
+  m_store = Store::from_memory (
+    detail::make_empty_trie<Score> ());
+
+  m_score_table = nullptr;
+  m_root = detail::make_trie_root (m_store->trie_data ().first);
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename Comparer>
+OrderedTrie<Score>::OrderedTrie (
+  std::shared_ptr<const Store>  store,
+  const Comparer               &score_comparer)
+  : m_rank_bound {make_rank_bound (score_comparer)}
+{
+  const auto trie_data = store->trie_data ().first;
+  BOOST_ASSERT (trie_data);
+
+  if (trie_data)
+  {
+    m_root = detail::make_trie_root (trie_data);
+    m_score_table = store->score_table_data ().first;
+    m_store = store;
+
+    m_top_k = detail::TopKIndex<Node>
+    {
+      store->top_k_data ().first,
+      store->top_k_data ().second,
+      store->trie_data ().first,
+      store->trie_data ().second
+    };
+
+    m_companions = detail::CompanionDirectory
+    {
+      store->companions_data ().first,
+      store->companions_data ().second
+    };
+
+    m_filter = detail::BloomFilter
+    {
+      store->filter_data ().first,
+      store->filter_data ().second
+    };
+  }
+}
+
+/***************************************************/
+
+template<typename Score>
+bool OrderedTrie<Score>::empty () const
+{
+  return m_root.is_leaf ();
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::begin () const
+  -> iterator
+{
+  return iterator
+  {
+    detail::visit_children (m_root),
+    *this
+  };
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::end () const
+  -> iterator
+{
+  return iterator {*this};
+}
+
+/***************************************************/
+template<typename Score>
+auto OrderedTrie<Score>::complete (
+  const std::string &prefix) const
+  -> boost::iterator_range<iterator>
+{
+  return complete (prefix.begin (), prefix.end ());
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::complete (FwdIt first, FwdIt last) const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*this};
+  start_visit (result.m_visitor, first, last);
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete (
+  const std::string &prefix,
+  QueryContext      &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  return complete (prefix.begin (), prefix.end (), context);
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::complete (
+  FwdIt         first,
+  FwdIt         last,
+  QueryContext &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  context.m_trie = this;
+  start_visit (context.m_visitor, first, last);
+
+  if (context.m_visitor)
+  {
+    make_completion (context.m_visitor, context.m_completion);
+  }
+
+  return boost::make_iterator_range (
+    context_iterator {context},
+    context_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete (
+  const std::string     &prefix,
+  const CompleteOptions &options) const
+  -> boost::iterator_range<iterator>
+{
+  return complete (prefix.begin (), prefix.end (), options);
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::complete (
+  FwdIt                  first,
+  FwdIt                  last,
+  const CompleteOptions &options) const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*this};
+  const auto limits = make_limits (options);
+
+  if (limits)
+  {
+    start_visit (result.m_visitor,
+		 first,
+		 last,
+		 *limits);
+  }
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete (
+  const std::string     &prefix,
+  const CompleteOptions &options,
+  QueryContext          &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  return complete (prefix.begin (), prefix.end (), options, context);
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::complete (
+  FwdIt                  first,
+  FwdIt                  last,
+  const CompleteOptions &options,
+  QueryContext          &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  context.m_trie = this;
+  context.m_visitor.reset ();
+
+  const auto limits = make_limits (options);
+
+  if (limits)
+  {
+    start_visit (context.m_visitor,
+		 first,
+		 last,
+		 *limits);
+  }
+
+  if (context.m_visitor)
+  {
+    make_completion (context.m_visitor, context.m_completion);
+  }
+
+  return boost::make_iterator_range (
+    context_iterator {context},
+    context_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_filtered (
+  const std::string   &prefix,
+  const std::uint64_t  categories) const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*this};
+
+  start_visit (result.m_visitor,
+	       prefix.begin (),
+	       prefix.end (),
+	       detail::VisitLimits {},
+	       categories);
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_filtered (
+  const std::string   &prefix,
+  const std::uint64_t  categories,
+  QueryContext        &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  context.m_trie = this;
+
+  start_visit (context.m_visitor,
+	       prefix.begin (),
+	       prefix.end (),
+	       detail::VisitLimits {},
+	       categories);
+
+  if (context.m_visitor)
+  {
+    make_completion (context.m_visitor, context.m_completion);
+  }
+
+  return boost::make_iterator_range (
+    context_iterator {context},
+    context_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdRange>
+auto OrderedTrie<Score>::complete_any (
+  const FwdRange &prefixes) const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*this};
+  start_visit_any (result.m_visitor, prefixes);
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_any (
+  std::initializer_list<boost::string_ref> prefixes) const
+  -> boost::iterator_range<iterator>
+{
+  return complete_any<std::initializer_list<boost::string_ref>> (
+    prefixes);
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdRange>
+auto OrderedTrie<Score>::complete_any (
+  const FwdRange &prefixes,
+  QueryContext   &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  context.m_trie = this;
+  start_visit_any (context.m_visitor, prefixes);
+
+  if (context.m_visitor)
+  {
+    make_completion (context.m_visitor, context.m_completion);
+  }
+
+  return boost::make_iterator_range (
+    context_iterator {context},
+    context_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::make_limits (
+  const CompleteOptions &options) const
+  -> boost::optional<detail::VisitLimits>
+{
+  detail::VisitLimits result;
+  result.max_expansions = options.max_expansions;
+  result.deadline = options.deadline;
+
+  if (options.min_score)
+  {
+    const auto table = m_store->score_table_data ();
+
+    const auto bound = m_rank_bound (
+      table.first,
+      table.second,
+      *options.min_score);
+
+    if (!bound)
+    {
+      return boost::none;
+    }
+
+    result.max_rank = *bound;
+  }
+
+  return result;
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_refs (
+  const std::string &prefix,
+  QueryContext      &context) const
+  -> boost::iterator_range<ref_iterator>
+{
+  return complete_refs (prefix.begin (), prefix.end (), context);
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::complete_refs (
+  FwdIt         first,
+  FwdIt         last,
+  QueryContext &context) const
+  -> boost::iterator_range<ref_iterator>
+{
+  context.m_trie = this;
+  start_visit (context.m_visitor, first, last);
+
+  /*
+   * References outlive the leaf they were taken at
+   */
+  context.m_visitor.retain_links ();
+
+  return boost::make_iterator_range (
+    ref_iterator {context},
+    ref_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::resume (const std::string &cursor) const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*this};
+  restore_cursor (result.m_visitor, cursor);
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::resume (
+  const std::string &cursor,
+  QueryContext      &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  context.m_trie = this;
+  restore_cursor (context.m_visitor, cursor);
+
+  if (context.m_visitor)
+  {
+    make_completion (context.m_visitor, context.m_completion);
+  }
+
+  return boost::make_iterator_range (
+    context_iterator {context},
+    context_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_fuzzy (
+  const std::string &prefix,
+  const std::size_t  max_edits) const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*this};
+
+  if (!empty ())
+  {
+    seed_loci (
+      result.m_visitor,
+      detail::fuzzy_prefix_loci (m_root,
+				 prefix.begin (),
+				 prefix.end (),
+				 max_edits,
+				 result.m_visitor));
+  }
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_fuzzy (
+  const std::string &prefix,
+  const std::size_t  max_edits,
+  QueryContext      &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  context.m_trie = this;
+  context.m_visitor.reset ();
+
+  if (!empty ())
+  {
+    seed_loci (
+      context.m_visitor,
+      detail::fuzzy_prefix_loci (m_root,
+				 prefix.begin (),
+				 prefix.end (),
+				 max_edits,
+				 context.m_visitor));
+  }
+
+  if (context.m_visitor)
+  {
+    make_completion (context.m_visitor, context.m_completion);
+  }
+
+  return boost::make_iterator_range (
+    context_iterator {context},
+    context_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_pattern (
+  const std::string &pattern) const
+  -> boost::iterator_range<iterator>
+{
+  const detail::GlobPattern automaton {pattern};
+  iterator result {*this};
+
+  if (!empty ())
+  {
+    seed_loci (
+      result.m_visitor,
+      detail::glob_pattern_loci (m_root, automaton, result.m_visitor));
+  }
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_pattern (
+  const std::string &pattern,
+  QueryContext      &context) const
+  -> boost::iterator_range<context_iterator>
+{
+  const detail::GlobPattern automaton {pattern};
+
+  context.m_trie = this;
+  context.m_visitor.reset ();
+
+  if (!empty ())
+  {
+    seed_loci (
+      context.m_visitor,
+      detail::glob_pattern_loci (m_root, automaton, context.m_visitor));
+  }
+
+  if (context.m_visitor)
+  {
+    make_completion (context.m_visitor, context.m_completion);
+  }
+
+  return boost::make_iterator_range (
+    context_iterator {context},
+    context_iterator {});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_folded (
+  const std::string &prefix) const
+  -> boost::iterator_range<companion_iterator>
+{
+  auto key = prefix;
+  detail::fold_ascii_case (key);
+
+  companion_iterator result {*this};
+
+  start_companion_visit (result.m_visitor,
+			 detail::COMPANION_FOLDED,
+			 key.begin (),
+			 key.end (),
+			 false);
+
+  return boost::make_iterator_range (
+    result,
+    companion_iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_infix (
+  const std::string &prefix) const
+  -> boost::iterator_range<companion_iterator>
+{
+  auto key = prefix;
+  detail::fold_ascii_case (key);
+
+  companion_iterator result {*this};
+
+  start_companion_visit (result.m_visitor,
+			 detail::COMPANION_WORD_STARTS,
+			 key.begin (),
+			 key.end (),
+			 true);
+
+  return boost::make_iterator_range (
+    result,
+    companion_iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::complete_suffix (
+  const std::string &suffix) const
+  -> boost::iterator_range<companion_iterator>
+{
+  companion_iterator result {*this};
+
+  start_companion_visit (result.m_visitor,
+			 detail::COMPANION_REVERSED,
+			 suffix.rbegin (),
+			 suffix.rend (),
+			 false);
+
+  return boost::make_iterator_range (
+    result,
+    companion_iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+void OrderedTrie<Score>::start_companion_visit (
+  detail::CompanionLeavesIterator<Node> &visitor,
+  const std::uint64_t                    kind,
+  FwdIt                                  first,
+  FwdIt                                  last,
+  const bool                             word_starts) const
+{
+  const auto companion = m_companions.find (kind);
+
+  if (companion.empty ())
+  {
+    throw std::logic_error ("Trie built without requested index");
+  }
+
+  const auto trie = m_store->trie_data ();
+
+  visitor.reset (companion,
+		 m_companions.find (detail::COMPANION_ANCESTORS),
+		 m_root,
+		 trie.first,
+		 trie.second,
+		 std::distance (first, last),
+		 word_starts);
+
+  const auto root = detail::make_trie_root (companion.first);
+  auto &visit = visitor.visit ();
+  auto path = visit.no_link;
+
+  const auto locus = detail::prefix_match (
+    root, first, last,
+    [&] (const Node &ancestor, const detail::SiblingsIterator<Node>&)
+    {
+      path = visit.append_link (ancestor, path);
+    });
+
+  if ((first == last) && !root.is_leaf ())
+  {
+    visit.seed (
+      detail::SiblingsIterator<Node>
+      {
+	locus,
+	Node::skip (locus.data ())
+      },
+      path);
+  }
+
+  visitor.start ();
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::lexicographic () const
+  -> boost::iterator_range<lexicographic_iterator>
+{
+  lexicographic_iterator first {*this};
+  first.m_visitor = detail::LexicographicIterator<Node> {m_root};
+
+  return boost::make_iterator_range (
+    first,
+    lexicographic_iterator {*this});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::lower_bound (const std::string &key) const
+  -> lexicographic_iterator
+{
+  lexicographic_iterator result {*this};
+  result.m_visitor.seek (m_root, key.begin (), key.end (), false);
+  return result;
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::upper_bound (const std::string &key) const
+  -> lexicographic_iterator
+{
+  lexicographic_iterator result {*this};
+  result.m_visitor.seek (m_root, key.begin (), key.end (), true);
+  return result;
+}
+
+/***************************************************/
+/*
+ * Cursors start with a format version and the size of the
+ * trie they refer to, as a cheap guard against cursors
+ * obtained from a different trie.
+ */
+namespace detail {
+
+constexpr std::uint64_t cursor_format_version = 2;
+
+} // namespace detail {
+
+template<typename Score>
+std::string OrderedTrie<Score>::save_cursor (
+  const detail::OrderedLeavesIterator<Node> &visitor) const
+{
+  const auto trie = m_store->trie_data ();
+  std::string result;
+
+  detail::append_varint (result, detail::cursor_format_version);
+  detail::append_varint (result, trie.second - trie.first);
+  visitor.save (result, trie.first);
+
+  return result;
+}
+
+/***************************************************/
+
+template<typename Score>
+void OrderedTrie<Score>::restore_cursor (
+  detail::OrderedLeavesIterator<Node> &visitor,
+  const std::string                   &cursor) const
+{
+  const auto trie = m_store->trie_data ();
+  auto first = cursor.begin ();
+
+  if ((detail::read_varint (first, cursor.end ()) !=
+       detail::cursor_format_version) ||
+      (detail::read_varint (first, cursor.end ()) !=
+       static_cast<std::uint64_t> (trie.second - trie.first)))
+  {
+    throw std::invalid_argument (
+      "Cursor not matching this trie");
+  }
+
+  visitor.restore (first,
+		   cursor.end (),
+		   m_root,
+		   trie.second,
+		   m_store->annotations ());
+
+  if (first != cursor.end ())
+  {
+    throw std::invalid_argument ("Trailing bytes in cursor");
+  }
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+void OrderedTrie<Score>::start_visit (
+  detail::OrderedLeavesIterator<Node> &visitor,
+  FwdIt                                first,
+  FwdIt                                last,
+  const detail::VisitLimits           &limits,
+  const boost::optional<std::uint64_t> &categories) const
+{
+  visitor.reset ();
+  visitor.limit (limits);
+
+  if (!categories)
+  {
+    if (!m_filter.may_start (first, last))
+    {
+      return;
+    }
+
+    const auto locus = match_locus (visitor, first, last);
+
+    if (locus)
+    {
+      visitor.seed (
+	detail::SiblingsIterator<Node>
+	{
+	  locus->first,
+	  Node::skip (locus->first.data ())
+	},
+	locus->second,
+	m_top_k.find (locus->first));
+    }
+
+    return;
+  }
+
+  /*
+   * Filtered visits skip subtries by their category mask,
+   * stored at their end: these are tracked from the root.
+   */
+  const auto annotations = m_store->annotations ();
+
+  if (!(annotations & detail::SUBTREE_CATEGORY_MASKS))
+  {
+    throw std::logic_error ("Trie built without category masks");
+  }
+
+  visitor.filter (*categories, annotations);
+
+  if (!m_filter.may_start (first, last))
+  {
+    return;
+  }
+
+  const auto *subtree_end = m_store->trie_data ().second;
+  const auto locus = match_locus (visitor, first, last, &subtree_end);
+
+  if (locus)
+  {
+    visitor.seed (
+      detail::SiblingsIterator<Node>
+      {
+	locus->first,
+	Node::skip (locus->first.data ())
+      },
+      locus->second,
+      subtree_end);
+  }
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdRange>
+void OrderedTrie<Score>::start_visit_any (
+  detail::OrderedLeavesIterator<Node> &visitor,
+  const FwdRange                      &prefixes) const
+{
+  visitor.reset ();
+
+  /*
+   * Completions of a prefix include the ones of the strings it
+   * prefixes: sort prefixes to keep only the shortest ones.
+   */
+  std::vector<boost::string_ref> sorted;
+
+  for (const auto &prefix : prefixes)
+  {
+    sorted.emplace_back (prefix);
+  }
+
+  std::sort (sorted.begin (), sorted.end ());
+
+  /*
+   * A prefix extending another one follows it, possibly after
+   * other ones extending it as well: compare each with the
+   * last one kept.
+   */
+  std::vector<boost::string_ref> kept;
+
+  for (const auto &prefix : sorted)
+  {
+    if (kept.empty () || !prefix.starts_with (kept.back ()))
+    {
+      kept.push_back (prefix);
+    }
+  }
+
+  if (kept.size () == 1)
+  {
+    start_visit (visitor, kept.front ().begin (), kept.front ().end ());
+    return;
+  }
+
+  std::vector<std::pair<Node, std::size_t>> loci;
+
+  for (const auto &prefix : kept)
+  {
+    if (!m_filter.may_start (prefix.begin (), prefix.end ()))
+    {
+      continue;
+    }
+
+    const auto locus = match_locus (visitor, prefix.begin (), prefix.end ());
+
+    if (locus)
+    {
+      loci.push_back (*locus);
+    }
+  }
+
+  seed_loci (visitor, std::move (loci));
+}
+
+/***************************************************/
+
+/*
+ * Add to the visit the subtries rooted at disjoint @p loci,
+ * each paired with the chain of labels leading to it.
+ */
+template<typename Score>
+void OrderedTrie<Score>::seed_loci (
+  detail::OrderedLeavesIterator<Node>        &visitor,
+  std::vector<std::pair<Node, std::size_t>>   loci) const
+{
+  /*
+   * Seed by increasing rank, as required by monotone frontiers
+   */
+  std::sort (loci.begin (), loci.end (),
+	     [] (const auto &lhs, const auto &rhs)
+	     {
+	       return lhs.first.rank () < rhs.first.rank ();
+	     });
+
+  for (const auto &locus : loci)
+  {
+    visitor.seed (
+      detail::SiblingsIterator<Node>
+      {
+	locus.first,
+	Node::skip (locus.first.data ())
+      },
+      locus.second);
+  }
+}
+
+/***************************************************/
+
+/*
+ * Node whose subtrie holds the completions of [first, last)
+ * and chain of labels leading to it, if any. If given, the
+ * end of the subtrie of the root in @p subtree_end is moved
+ * to the one of the matched node.
+ */
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::match_locus (
+  detail::OrderedLeavesIterator<Node> &visitor,
+  FwdIt                                first,
+  FwdIt                                last,
+  const std::uint8_t                 **subtree_end) const
+  -> boost::optional<std::pair<Node, std::size_t>>
+{
+  if (empty ())
+  {
+    return boost::none;
+  }
+
+  auto path = visitor.no_link;
+
+  const auto match_node = detail::prefix_match (
+    m_root, first, last,
+    [&] (const Node &ancestor,
+	 const detail::SiblingsIterator<Node> &child)
+    {
+      path = visitor.append_link (ancestor, path);
+
+      if (subtree_end)
+      {
+	*subtree_end = detail::child_subtree_end (
+	  ancestor, *subtree_end, child, m_store->annotations ());
+      }
+    });
+
+  if (first != last)
+  {
+    return boost::none;
+  }
+
+  return std::make_pair (match_node, path);
+}
+
+/***************************************************/
+
+template<typename Score>
+void OrderedTrie<Score>::make_completion (
+  const detail::OrderedLeavesIterator<Node> &visitor,
+  value_type                                &output) const
+{
+  output.first.clear ();
+  visitor.write_string (visitor.path (), *visitor, output.first);
+
+  output.second = deserialise<Score> (
+    m_score_table + visitor->rank ());
+}
+
+/***************************************************/
+
+template<typename Score>
+void OrderedTrie<Score>::seed_path (
+  detail::OrderedLeavesIterator<Node> &visitor,
+  const std::vector<Node>             &nodes) const
+{
+  const auto &locus = nodes.back ();
+  auto path = visitor.no_link;
+
+  visitor.reset ();
+
+  for (std::size_t j = 0; j + 1 < nodes.size (); ++j)
+  {
+    path = visitor.append_link (nodes[j], path);
+  }
+
+  visitor.seed (
+    detail::SiblingsIterator<Node> {locus, Node::skip (locus.data ())},
+    path,
+    m_top_k.find (locus));
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::follow_byte (const Node         &locus,
+				      const std::size_t   offset,
+				      const std::uint8_t  byte)
+  -> boost::optional<Node>
+{
+  if (offset < locus.label_size ())
+  {
+    return (locus.label_begin ()[offset] == byte) ?
+      boost::make_optional (locus) : boost::none;
+  }
+
+  auto children_it = detail::find_sibling (
+    detail::visit_children (locus), [byte] (const Node &node)
+    {
+      return node.label_size () && (*node.label_begin () == byte);
+    });
+
+  return children_it ? boost::make_optional (*children_it) : boost::none;
+}
+
+/***************************************************/
+
+template<typename Score>
+std::size_t OrderedTrie<Score>::collect_completions (
+  detail::OrderedLeavesIterator<Node> &visitor,
+  const Node                          &locus,
+  const std::string                   &head,
+  const std::size_t                    k,
+  std::vector<value_type>             &output) const
+{
+  visitor.reset ();
+  visitor.seed (
+    detail::SiblingsIterator<Node> {locus, Node::skip (locus.data ())},
+    visitor.no_link,
+    m_top_k.find (locus));
+
+  std::size_t n = 0;
+
+  for (; visitor && (n < k); ++visitor, ++n)
+  {
+    if (n == output.size ())
+    {
+      output.emplace_back ();
+    }
+
+    auto &completion = output[n];
+    completion.first.assign (head);
+    visitor.write_string (visitor.path (), *visitor, completion.first);
+    completion.second = deserialise<Score> (m_score_table + visitor->rank ());
+  }
+
+  return n;
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::summarise (
+  FwdIt               first,
+  FwdIt               last,
+  const std::uint64_t required) const
+  -> boost::optional<detail::SubtreeSummary>
+{
+  if (empty ())
+  {
+    return boost::none;
+  }
+
+  const auto annotations = m_store->annotations ();
+  const auto annotated = ((annotations & required) == required);
+  const auto *subtree_end = m_store->trie_data ().second;
+
+  const auto locus = detail::prefix_match (
+    m_root, first, last,
+    [&] (const Node &ancestor,
+	 const detail::SiblingsIterator<Node> &child)
+    {
+      if (annotated)
+      {
+	subtree_end = detail::child_subtree_end (
+	  ancestor, subtree_end, child, annotations);
+      }
+    });
+
+  if (first != last)
+  {
+    return boost::none;
+  }
+
+  if (locus.is_leaf ())
+  {
+    detail::SubtreeSummary result;
+    result.leaf_count = 1;
+    result.min_rank = result.max_rank = locus.rank ();
+    return result;
+  }
+
+  if (!annotated)
+  {
+    return detail::visit_subtree_summary (locus);
+  }
+
+  auto result = detail::read_subtree_summary (
+    locus, subtree_end, annotations);
+
+  /* Unlike other nodes, the root has null rank */
+  if (locus == m_root)
+  {
+    result.min_rank = detail::visit_children (m_root)->rank ();
+  }
+
+  return result;
+}
+
+/***************************************************/
+
+template<typename Score>
+size_t OrderedTrie<Score>::count_completions (
+  const std::string &prefix) const
+{
+  return count_completions (prefix.begin (), prefix.end ());
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+size_t OrderedTrie<Score>::count_completions (FwdIt first,
+					      FwdIt last) const
+{
+  const auto summary =
+    summarise (first, last, detail::SUBTREE_LEAF_COUNTS);
+
+  return summary ? summary->leaf_count : 0u;
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::score_aggregate (
+  const std::string &prefix) const
+  -> boost::optional<std::pair<Score, Score>>
+{
+  return score_aggregate (prefix.begin (), prefix.end ());
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+auto OrderedTrie<Score>::score_aggregate (FwdIt first,
+					  FwdIt last) const
+  -> boost::optional<std::pair<Score, Score>>
+{
+  const auto summary =
+    summarise (first, last, detail::SUBTREE_RANK_RANGES);
+
+  if (!summary)
+  {
+    return boost::none;
+  }
+
+  return std::make_pair (
+    deserialise<Score> (m_score_table + summary->min_rank),
+    deserialise<Score> (m_score_table + summary->max_rank));
+}
+
+/***************************************************/
+template<typename Score>
+size_t OrderedTrie<Score>::mismatch (
+  const std::string &prefix) const
+{
+  auto f = prefix.begin ();
+  detail::prefix_match (m_root, f, prefix.end ());
+  return std::distance (prefix.begin (), f);
+}
+  
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+FwdIt
+OrderedTrie<Score>::mismatch (FwdIt first,
+			      const FwdIt last) const
+{
+  detail::prefix_match (m_root, first, last);
+  return first;
+}
+
+/***************************************************/
+
+template<typename Score>
+size_t OrderedTrie<Score>::count (const std::string &prefix) const
+{
+  return count (prefix.begin (), prefix.end ());
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+size_t OrderedTrie<Score>::count (FwdIt first,
+				  const FwdIt last) const
+{
+  if (!m_filter.may_contain (first, last))
+  {
+    return 0u;
+  }
+
+  auto locus = m_root;
+  
+  if (detail::find_leaf (locus, first, last))
+  {
+    return (locus == m_root) ? 0u : 1u;
+  }
+  
+  return 0u;
+}
+  
+/***************************************************/
+
+template<typename Score>
+void OrderedTrie<Score>::CompletionSession::push_back (const char c)
+{
+  m_prefix.push_back (c);
+
+  if (m_matched + 1 != m_prefix.size ())
+  {
+    return;
+  }
+
+  const auto &locus = m_nodes.back ();
+  const auto offset = label_offset ();
+  const auto next = m_trie->follow_byte (
+    locus, offset, static_cast<std::uint8_t> (c));
+
+  if (!next)
+  {
+    return;
+  }
+
+  if (offset < locus.label_size ())
+  {
+    m_frames.push_back ({static_cast<std::uint8_t> (offset + 1)});
+  }
+  else
+  {
+    m_nodes.push_back (*next);
+    m_frames.push_back ({1});
+  }
+
+  ++m_matched;
+}
+
+/***************************************************/
+
+template<typename Score>
+void OrderedTrie<Score>::CompletionSession::pop_back ()
+{
+  if (m_prefix.empty ())
+  {
+    throw std::logic_error ("Empty session prefix");
+  }
+
+  if (m_matched == m_prefix.size ())
+  {
+    if (m_frames.back ().offset == 1)
+    {
+      m_nodes.pop_back ();
+    }
+
+    m_frames.pop_back ();
+    --m_matched;
+  }
+
+  m_prefix.pop_back ();
+}
+
+/***************************************************/
+
+template<typename Score>
+void OrderedTrie<Score>::CompletionSession::assign (
+  const std::string &prefix)
+{
+  const auto common = std::mismatch (
+    m_prefix.begin (),
+    m_prefix.begin () + std::min (m_prefix.size (), prefix.size ()),
+    prefix.begin ()).second - prefix.begin ();
+
+  while (m_prefix.size () > static_cast<std::size_t> (common))
+  {
+    pop_back ();
+  }
+
+  for (auto it = prefix.begin () + common; it != prefix.end (); ++it)
+  {
+    push_back (*it);
+  }
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::CompletionSession::complete () const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*m_trie};
+
+  if (matched ())
+  {
+    m_trie->seed_path (result.m_visitor, m_nodes);
+  }
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*m_trie});
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::CompletionSession::top (const std::size_t k)
+  -> boost::iterator_range<const_iterator>
+{
+  const auto extends = m_top_valid &&
+    (m_prefix.compare (0, m_top_prefix.size (), m_top_prefix) == 0);
+
+  if (extends && (m_top_prefix.size () < m_prefix.size ()))
+  {
+    m_top.erase (
+      std::remove_if (m_top.begin (), m_top.end (),
+		      [this] (const value_type &c)
+		      {
+			return c.first.compare (
+			  0, m_prefix.size (), m_prefix) != 0;
+		      }),
+      m_top.end ());
+
+    m_top_prefix = m_prefix;
+  }
+
+  if (!extends || (!m_top_exhaustive && (m_top.size () < k)))
+  {
+    m_top.clear ();
+    m_top_prefix = m_prefix;
+    m_top_valid = true;
+
+    if (matched ())
+    {
+      m_trie->seed_path (m_visitor, m_nodes);
+
+      for (; m_visitor && (m_top.size () < k); ++m_visitor)
+      {
+	m_top.emplace_back ();
+	m_trie->make_completion (m_visitor, m_top.back ());
+      }
+    }
+
+    m_top_exhaustive = !matched () || !m_visitor;
+  }
+
+  return boost::make_iterator_range (
+    m_top.cbegin (),
+    m_top.cbegin () + std::min (k, m_top.size ()));
+}
+
+/***************************************************/
+
+template<typename Score>
+bool OrderedTrie<Score>::PrefixCursor::advance (const char c)
+{
+  const auto &locus = m_nodes.back ();
+  const auto next = m_trie->follow_byte (
+    locus, m_offset, static_cast<std::uint8_t> (c));
+
+  if (!next)
+  {
+    return false;
+  }
+
+  if (m_offset < locus.label_size ())
+  {
+    ++m_offset;
+  }
+  else
+  {
+    m_nodes.push_back (*next);
+    m_offset = 1;
+  }
+
+  m_prefix.push_back (c);
+  return true;
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdIt>
+FwdIt OrderedTrie<Score>::PrefixCursor::advance (FwdIt first,
+						 const FwdIt last)
+{
+  for (; (first != last) && advance (*first); ++first)
+  {
+  }
+
+  return first;
+}
+
+/***************************************************/
+
+template<typename Score>
+std::string OrderedTrie<Score>::PrefixCursor::children () const
+{
+  const auto &locus = m_nodes.back ();
+  std::string result;
+
+  if (m_offset < locus.label_size ())
+  {
+    result.push_back (static_cast<char> (locus.label_begin ()[m_offset]));
+    return result;
+  }
+
+  for (auto it = detail::visit_children (locus); it; ++it)
+  {
+    if (it->label_size ())
+    {
+      result.push_back (static_cast<char> (*it->label_begin ()));
+    }
+  }
+
+  std::sort (result.begin (), result.end (),
+	     [] (const char lhs, const char rhs)
+	     {
+	       return static_cast<std::uint8_t> (lhs) <
+		 static_cast<std::uint8_t> (rhs);
+	     });
+
+  return result;
+}
+
+/***************************************************/
+
+template<typename Score>
+Score OrderedTrie<Score>::PrefixCursor::score () const
+{
+  const auto leaf = terminal_leaf ();
+
+  if (!leaf)
+  {
+    throw std::logic_error (
+      "No leaf node associated to cursor prefix");
+  }
+
+  return deserialise<Score> (m_trie->m_score_table + leaf->rank ());
+}
+
+/***************************************************/
+
+template<typename Score>
+auto OrderedTrie<Score>::PrefixCursor::complete () const
+  -> boost::iterator_range<iterator>
+{
+  iterator result {*m_trie};
+
+  if (!m_trie->empty ())
+  {
+    m_trie->seed_path (result.m_visitor, m_nodes);
+  }
+
+  return boost::make_iterator_range (
+    result,
+    iterator {*m_trie});
+}
+
+/***************************************************/
 
 template<typename Score>
-auto OrderedTrie<Score>::begin () const
-  -> iterator
+auto OrderedTrie<Score>::PrefixCursor::terminal_leaf () const
+  -> boost::optional<Node>
 {
-  return iterator
+  const auto &locus = m_nodes.back ();
+
+  if (m_offset < locus.label_size ())
   {
-    detail::visit_children (m_root),
-    *this
-  };
+    return boost::none;
+  }
+
+  if (locus.is_leaf ())
+  {
+    return (m_nodes.size () > 1) ?
+      boost::make_optional (locus) : boost::none;
+  }
+
+  auto leaf_it = detail::find_sibling (
+    detail::visit_children (locus),
+    [] (const Node &node)
+    {
+      return node.is_leaf () && !node.label_size ();
+    });
+
+  return leaf_it ? boost::make_optional (*leaf_it) : boost::none;
 }
 
 /***************************************************/
 
 template<typename Score>
-auto OrderedTrie<Score>::end () const
-  -> iterator
+auto OrderedTrie<Score>::prefix_cursor (const std::string &input) const
+  -> PrefixCursor
 {
-  return iterator {*this};
+  PrefixCursor result {*this};
+  result.advance (input.begin (), input.end ());
+  return result;
 }
 
 /***************************************************/
+
 template<typename Score>
-auto OrderedTrie<Score>::complete (
-  const std::string &prefix) const
-  -> boost::iterator_range<iterator>
+template<typename FwdRange>
+std::vector<size_t> OrderedTrie<Score>::count_batch (
+  const FwdRange &inputs) const
 {
-  return complete (prefix.begin (), prefix.end ());
+  using std::begin;
+  using std::end;
+
+  std::vector<size_t> result (std::distance (begin (inputs), end (inputs)));
+
+  detail::interleave_descents (
+    m_root, begin (inputs), end (inputs), true,
+    detail::interleaved_descents,
+    [&result] (const std::size_t j, const auto &descent)
+    {
+      result[j] = descent.found () ? 1u : 0u;
+    });
+
+  return result;
 }
 
 /***************************************************/
 
 template<typename Score>
-template<typename FwdIt>
-auto OrderedTrie<Score>::complete (FwdIt first, FwdIt last) const
-  -> boost::iterator_range<iterator>
+template<typename FwdRange>
+std::vector<boost::optional<Score>> OrderedTrie<Score>::score_batch (
+  const FwdRange &inputs) const
 {
-  if (!empty ())
-  {
-    auto match_node =
-      detail::prefix_match (m_root, first, last);
+  using std::begin;
+  using std::end;
+
+  std::vector<boost::optional<Score>> result (
+    std::distance (begin (inputs), end (inputs)));
 
-    if (first == last)
+  detail::interleave_descents (
+    m_root, begin (inputs), end (inputs), true,
+    detail::interleaved_descents,
+    [&] (const std::size_t j, const auto &descent)
     {
-      detail::SiblingsIterator<Node> search_loc
+      if (descent.found ())
       {
-	match_node,
-	Node::skip (match_node.data ())
-      };
+	result[j] = deserialise<Score> (
+	  m_score_table + descent.locus ().rank ());
+      }
+    });
 
-      return boost::make_iterator_range (
-	iterator {search_loc, *this},
-	iterator {*this});
-    }
+  return result;
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename FwdRange, typename OutputIt>
+OutputIt OrderedTrie<Score>::count_sorted (const FwdRange &inputs,
+					   OutputIt        output) const
+{
+  detail::SharedPrefixLookup<Node> lookup {m_root};
+  Node leaf;
+
+  for (const auto &input : inputs)
+  {
+    using std::begin;
+    using std::end;
+
+    *output++ = lookup.find (begin (input), end (input), leaf) ? 1u : 0u;
   }
 
-  return boost::make_iterator_range (
-    iterator {*this},
-    iterator {*this});
+  return output;
 }
 
 /***************************************************/
+
 template<typename Score>
-size_t OrderedTrie<Score>::mismatch (
-  const std::string &prefix) const
+template<typename FwdRange, typename OutputIt>
+OutputIt OrderedTrie<Score>::score_sorted (const FwdRange &inputs,
+					   OutputIt        output) const
 {
-  auto f = prefix.begin ();
-  detail::prefix_match (m_root, f, prefix.end ());
-  return std::distance (prefix.begin (), f);
+  detail::SharedPrefixLookup<Node> lookup {m_root};
+  Node leaf;
+
+  for (const auto &input : inputs)
+  {
+    using std::begin;
+    using std::end;
+
+    boost::optional<Score> score;
+
+    if (lookup.find (begin (input), end (input), leaf))
+    {
+      score = deserialise<Score> (m_score_table + leaf.rank ());
+    }
+
+    *output++ = std::move (score);
+  }
+
+  return output;
 }
-  
+
 /***************************************************/
 
 template<typename Score>
-template<typename FwdIt>
-FwdIt
-OrderedTrie<Score>::mismatch (FwdIt first,
-			      const FwdIt last) const
+template<typename RandomAccessRange, typename Sink>
+void OrderedTrie<Score>::parallel_complete (
+  const RandomAccessRange &prefixes,
+  const std::size_t        k,
+  Sink                   &&sink,
+  const std::size_t        threads) const
 {
-  detail::prefix_match (m_root, first, last);
-  return first;
+  using std::begin;
+  using std::end;
+
+  const auto count = static_cast<std::size_t> (
+    std::distance (begin (prefixes), end (prefixes)));
+
+  const auto workers =
+    detail::worker_count (threads, count, detail::parallel_grain);
+
+  /*
+   * Each worker reuses its visitor and its completions, whose
+   * strings keep their capacity across prefixes
+   */
+  struct Worker
+  {
+    detail::OrderedLeavesIterator<Node> visitor;
+    std::vector<boost::optional<std::pair<Node, std::size_t>>> loci;
+    std::vector<value_type> completions;
+    std::string head;
+  };
+
+  std::vector<Worker> states (workers);
+
+  detail::run_work_stealing (
+    count, workers, detail::parallel_grain,
+    [&] (const std::size_t w, const std::size_t first, const std::size_t last)
+    {
+      auto &state = states[w];
+      const auto chunk = std::next (begin (prefixes), first);
+
+      state.loci.assign (last - first, boost::none);
+
+      if (!empty () && (k != 0))
+      {
+	detail::interleave_descents (
+	  m_root, chunk, std::next (chunk, last - first), false,
+	  detail::interleaved_descents,
+	  [&state] (const std::size_t j, const auto &descent)
+	  {
+	    if (descent.found ())
+	    {
+	      state.loci[j] = std::make_pair (descent.locus (), descent.depth ());
+	    }
+	  });
+      }
+
+      auto prefix = chunk;
+
+      for (std::size_t j = 0; j < last - first; ++j, ++prefix)
+      {
+	std::size_t n = 0;
+
+	if (state.loci[j])
+	{
+	  state.head.assign (begin (*prefix),
+			     std::next (begin (*prefix), state.loci[j]->second));
+
+	  n = collect_completions (state.visitor,
+				   state.loci[j]->first,
+				   state.head,
+				   k,
+				   state.completions);
+	}
+
+	sink (w, first + j,
+	      boost::make_iterator_range (state.completions.cbegin (),
+					  state.completions.cbegin () + n));
+      }
+    });
 }
 
 /***************************************************/
 
 template<typename Score>
-size_t OrderedTrie<Score>::count (const std::string &prefix) const
+auto OrderedTrie<Score>::parallel_export (const ExportOrder order,
+					  const std::size_t threads,
+					  const std::size_t depth) const
+  -> std::vector<std::vector<value_type>>
 {
-  return count (prefix.begin (), prefix.end ());
+  if (empty ())
+  {
+    return {};
+  }
+
+  const auto partitions = detail::partition_subtries (m_root, depth);
+  const auto by_rank = (order != EXPORT_LEXICOGRAPHIC);
+
+  std::vector<std::vector<value_type>> result (partitions.size ());
+  std::vector<std::vector<std::uint64_t>> ranks (
+    (order == EXPORT_RANK) ? partitions.size () : 0);
+
+  struct Worker
+  {
+    detail::OrderedLeavesIterator<Node> visitor;
+    detail::LexicographicIterator<Node> lexicographic;
+  };
+
+  const auto workers = detail::worker_count (threads, partitions.size (), 1);
+  std::vector<Worker> states (workers);
+
+  detail::run_work_stealing (
+    partitions.size (), workers, 1,
+    [&] (const std::size_t w, const std::size_t first, const std::size_t last)
+    {
+      auto &state = states[w];
+
+      for (auto p = first; p != last; ++p)
+      {
+	const auto &locus = partitions[p].first;
+	const auto &head = partitions[p].second;
+	auto &output = result[p];
+
+	const auto append = [&] (const Node &leaf)
+	{
+	  output.emplace_back ();
+	  output.back ().first.assign (head);
+	  output.back ().second = deserialise<Score> (
+	    m_score_table + leaf.rank ());
+
+	  if (!ranks.empty ())
+	  {
+	    ranks[p].push_back (leaf.rank ());
+	  }
+
+	  return &output.back ().first;
+	};
+
+	if (by_rank)
+	{
+	  auto &visitor = state.visitor;
+
+	  visitor.reset ();
+	  visitor.seed (
+	    detail::SiblingsIterator<Node> {locus, Node::skip (locus.data ())},
+	    visitor.no_link,
+	    m_top_k.find (locus));
+
+	  for (; visitor; ++visitor)
+	  {
+	    visitor.write_string (visitor.path (), *visitor, *append (*visitor));
+	  }
+	}
+	else if (locus.is_leaf ())
+	{
+	  append (locus)->append (locus.label_begin (),
+				  locus.label_begin () + locus.label_size ());
+	}
+	else
+	{
+	  auto &it = state.lexicographic;
+	  const auto *label = locus.label_begin ();
+
+	  for (it.seek (locus, label, label, false); it; ++it)
+	  {
+	    auto &string = *append (*it);
+	    string.append (label, label + locus.label_size ());
+	    it.write_string (string);
+	  }
+	}
+      }
+    });
+
+  if (order != EXPORT_RANK)
+  {
+    return result;
+  }
+
+  /*
+   * Leaf ranks are global: merge the partitions by them
+   */
+  using Head = std::pair<std::uint64_t, std::size_t>;
+
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+  std::vector<std::size_t> positions (result.size ());
+  std::size_t total = 0;
+
+  for (std::size_t p = 0; p < result.size (); ++p)
+  {
+    total += result[p].size ();
+
+    if (!result[p].empty ())
+    {
+      heads.emplace (ranks[p].front (), p);
+    }
+  }
+
+  std::vector<value_type> merged;
+  merged.reserve (total);
+
+  while (!heads.empty ())
+  {
+    const auto p = heads.top ().second;
+    heads.pop ();
+
+    auto &position = positions[p];
+    merged.push_back (std::move (result[p][position]));
+
+    if (++position != result[p].size ())
+    {
+      heads.emplace (ranks[p][position], p);
+    }
+  }
+
+  result.clear ();
+  result.push_back (std::move (merged));
+  return result;
 }
 
 /***************************************************/
 
 template<typename Score>
-template<typename FwdIt>
-size_t OrderedTrie<Score>::count (FwdIt first,
-				  const FwdIt last) const
+template<typename FwdRange>
+auto OrderedTrie<Score>::complete_batch (
+  const FwdRange    &prefixes,
+  const std::size_t  k) const
+  -> std::vector<std::vector<value_type>>
 {
-  auto locus = m_root;
-  
-  if (detail::find_leaf (locus, first, last))
+  using std::begin;
+  using std::end;
+
+  std::vector<std::vector<value_type>> result (
+    std::distance (begin (prefixes), end (prefixes)));
+
+  if (empty () || (k == 0))
   {
-    return (locus == m_root) ? 0u : 1u;
+    return result;
   }
-  
-  return 0u;
+
+  /*
+   * Match all prefixes first, then visit their subtries
+   * spelling the strings from the matched nodes.
+   */
+  std::vector<boost::optional<std::pair<Node, std::size_t>>> loci (
+    result.size ());
+
+  detail::interleave_descents (
+    m_root, begin (prefixes), end (prefixes), false,
+    detail::interleaved_descents,
+    [&loci] (const std::size_t j, const auto &descent)
+    {
+      if (descent.found ())
+      {
+	loci[j] = std::make_pair (descent.locus (), descent.depth ());
+      }
+    });
+
+  detail::OrderedLeavesIterator<Node> visitor;
+  auto prefix = begin (prefixes);
+
+  for (std::size_t j = 0; j < result.size (); ++j, ++prefix)
+  {
+    if (loci[j])
+    {
+      collect_completions (
+	visitor,
+	loci[j]->first,
+	std::string (begin (*prefix),
+		     std::next (begin (*prefix), loci[j]->second)),
+	k,
+	result[j]);
+    }
+  }
+
+  return result;
 }
-  
+
+/***************************************************/
+
+#if ORDERED_TRIE_HAS_COROUTINES
+template<typename Score>
+auto OrderedTrie<Score>::lookup_interleaved (
+  const std::vector<Lookup> &lookups) const
+  -> std::vector<LookupResult>
+{
+  std::vector<LookupResult> result (lookups.size ());
+  std::vector<detail::DescentResult<Node>> descents (lookups.size ());
+  detail::OrderedLeavesIterator<Node> visitor;
+
+  detail::interleave_tasks (
+    lookups.size (),
+    detail::interleaved_descents,
+    [&] (const std::size_t j)
+    {
+      const auto &input = lookups[j].input;
+
+      return detail::descend (m_root,
+			      input.begin (),
+			      input.end (),
+			      lookups[j].kind == Lookup::SCORE,
+			      descents[j]);
+    },
+    [&] (const std::size_t j)
+    {
+      const auto &descent = descents[j];
+
+      if (!descent.found)
+      {
+	return;
+      }
+
+      if (lookups[j].kind == Lookup::SCORE)
+      {
+	result[j].score = deserialise<Score> (
+	  m_score_table + descent.locus.rank ());
+      }
+      else if (!empty ())
+      {
+	collect_completions (
+	  visitor,
+	  descent.locus,
+	  lookups[j].input.substr (0, descent.depth),
+	  lookups[j].k,
+	  result[j].completions);
+      }
+    });
+
+  return result;
+}
+#endif
+
 /***************************************************/
 
 template<typename Score>
@@ -512,7 +3199,7 @@ Score OrderedTrie<Score>::score (FwdIt first,
 				 const FwdIt last) const
 {
   auto locus = m_root;
-  const auto found =
+  const auto found = m_filter.may_contain (first, last) &&
     detail::find_leaf (locus, first, last);
   
   if (!found || (locus == m_root))
@@ -534,7 +3221,8 @@ bool OrderedTrie<Score>::score (Score &output,
 {
   auto locus = m_root;
 
-  if (detail::find_leaf (locus, first, last) &&
+  if (m_filter.may_contain (first, last) &&
+      detail::find_leaf (locus, first, last) &&
       !(locus == m_root))
   {
     output = deserialise<Score> (m_score_table + locus.rank());
@@ -577,7 +3265,91 @@ template<typename Score>
 auto OrderedTrie<Score>::read (const std::string &path)
   -> OrderedTrie<Score>
 {
-  return OrderedTrie<Score> {Store::from_file (path)};
+  /*
+   * A trie built with another comparer loads, but cannot bound
+   * its completions by score. Scores are checked on the first
+   * bounded query rather than here, once for all the copies
+   * of the trie.
+   */
+  struct SortedScores
+  {
+    std::once_flag checked;
+    bool sorted = false;
+  };
+
+  const auto store = Store::from_file (path);
+  OrderedTrie<Score> result {store, std::greater<Score> {}};
+
+  const auto scores = std::make_shared<SortedScores> ();
+  auto bound = std::move (result.m_rank_bound);
+
+  result.m_rank_bound = [scores, bound] (const std::uint8_t *first,
+					 const std::uint8_t *last,
+					 const Score        &score)
+  {
+    std::call_once (scores->checked, [&]
+    {
+      scores->sorted = detail::score_table_sorted<Score> (
+	first,
+	last,
+	std::greater<Score> {},
+	detail::FixedSizeScores<Score> {});
+    });
+
+    if (!scores->sorted)
+    {
+      throw std::logic_error (
+	"Trie read without the comparer it was built with");
+    }
+
+    return bound (first, last, score);
+  };
+
+  return result;
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename Comparer>
+auto OrderedTrie<Score>::read (const std::string &path,
+			       const Comparer    &score_comparer)
+  -> OrderedTrie<Score>
+{
+  const auto store = Store::from_file (path);
+  const auto table = store->score_table_data ();
+
+  if (!detail::score_table_sorted<Score> (
+	table.first,
+	table.second,
+	score_comparer,
+	detail::FixedSizeScores<Score> {}))
+  {
+    throw std::invalid_argument (
+      "Scores not ordered by the given comparer");
+  }
+
+  return OrderedTrie<Score> {store, score_comparer};
+}
+
+/***************************************************/
+
+template<typename Score>
+template<typename Comparer>
+auto OrderedTrie<Score>::make_rank_bound (const Comparer &score_comparer)
+  -> RankBound
+{
+  return [score_comparer] (const std::uint8_t *first,
+			   const std::uint8_t *last,
+			   const Score        &score)
+  {
+    return detail::score_rank_bound (
+      first,
+      last,
+      score,
+      score_comparer,
+      detail::FixedSizeScores<Score> {});
+  };
 }
 
 /***************************************************/
@@ -602,6 +3374,28 @@ auto make_ordered_trie (const FwdRange &suggestions,
 
 /***************************************************/
 
+template<typename FwdRange, typename Comparer>
+auto make_ordered_trie (const FwdRange     &suggestions,
+			const Comparer     &score_comparer,
+			const BuildOptions &options)
+{
+  using Suggestion =
+    typename boost::range_value<FwdRange>::type;
+
+  using Score = std::decay_t<
+    decltype (std::get<1> (std::declval<Suggestion> ()))>;
+
+  return OrderedTrie<Score>
+  {
+    std::begin (suggestions),
+    std::end (suggestions),
+    score_comparer,
+    options
+  };
+}
+
+/***************************************************/
+
 template<typename FwdRange>
 auto make_ordered_trie (const FwdRange &suggestions)
 {
@@ -11,12 +11,22 @@
 #ifndef DETAIL_ORDERED_TRIE_ITERATOR_HPP
 #define DETAIL_ORDERED_TRIE_ITERATOR_HPP
 
+#include "ordered_trie_frontier.hpp"
+#include "ordered_trie_node.hpp"
+#include "ordered_trie_top_k.hpp"
+#include "ordered_trie_varint.hpp"
+
 #include <boost/iterator.hpp>
+#include <boost/optional.hpp>
 #include <boost/range.hpp>
 
-#include <queue>
+#include <algorithm>
+#include <chrono>
+#include <limits>
 #include <stack>
+#include <stdexcept>
 #include <tuple>
+#include <vector>
 
 namespace ordered_trie {
 namespace detail {
@@ -152,127 +162,1077 @@ auto find_sibling (SiblingsIterator &&siblings_it,
   return std::move (siblings_it);
 }
  
+/**
+ * Visit downward path to a given descendant calling input
+ * functor on each node except source.
+ */
+template<typename Node, typename F>
+void traverse_descending_path (Node source,
+			       const Node &destination,
+			       F&& f);
+
+/**
+ * Prefetch policy of the ordered visit issuing no hint.
+ */
+struct NoPrefetch
+{
+  template<typename Node>
+  static void on_push (const Node&) {}
+};
+
+/**
+ * Prefetch policy of the ordered visit requesting, as soon as a
+ * node enters the frontier, the cache lines it is going to touch
+ * when expanded (its first child) or advanced (the header of its
+ * next sibling).
+ */
+struct PrefetchChildren
+{
+  template<typename Node>
+  static void on_push (const Node &node)
+  {
+#if defined (__GNUC__)
+    if (!node.is_leaf ())
+    {
+      __builtin_prefetch (node.first_child ());
+    }
+
+    __builtin_prefetch (Node::skip (node.data ()));
+#endif
+  }
+};
+
+/**
+ * Bounds of an ordered visit
+ */
+struct VisitLimits
+{
+  /**
+   * Highest rank of the leaves to reach
+   */
+  std::uint64_t max_rank =
+    std::numeric_limits<std::uint64_t>::max ();
+
+  /**
+   * Maximum number of internal nodes to expand
+   */
+  std::size_t max_expansions =
+    std::numeric_limits<std::size_t>::max ();
+
+  /**
+   * Time after which no more node is expanded
+   */
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::time_point::max ();
+};
+
+/**
+ * Element of the frontier of an ordered visit: a siblings
+ * range plus the chain of labels leading to it. Visits
+ * reading subtree annotations also track the end of the
+ * subtrie of the last sibling.
+ */
+template<typename Node>
+struct FrontierEntry
+{
+  SiblingsIterator<Node> siblings;
+  std::size_t path;
+  const std::uint8_t *parent_end = nullptr;
+
+  std::uint64_t rank () const
+  {
+    return siblings->rank ();
+  }
+
+  /**
+   * Order by rank, then by node address
+   */
+  bool operator< (const FrontierEntry &other) const
+  {
+    const auto lhs_rank = rank ();
+    const auto rhs_rank = other.rank ();
+
+    if (lhs_rank != rhs_rank)
+    {
+      return lhs_rank < rhs_rank;
+    }
+
+    return *siblings < *other.siblings;
+  }
+};
+
 /**
  * Iterate subtree leaves by increasing rank.
  *
+ * Every frontier entry refers to the chain of labels leading to
+ * its siblings range, stored as a parent-linked list in an arena
+ * shared by all entries. This allows to spell the string of the
+ * current leaf without descending again from the trie root.
+ * Links are counted by the entries and links referring to them,
+ * and their slots reused once unreferenced: the arena holds the
+ * chains of the frontier, not of every expanded node. Chains
+ * built by append_link() are kept until reset().
+ *
+ * The priority queue holding the frontier is selected by the
+ * @p Frontier template (see ordered_trie_frontier.hpp), while
+ * @p Prefetch selects the memory hints issued on the nodes
+ * entering the frontier.
+ *
+ * The first leaves of the visit can be served from a precomputed
+ * list (see ordered_trie_top_k.hpp), in which case the frontier
+ * is only filled once the list is exhausted.
+ *
+ * The visit can be bounded by VisitLimits: it stops before
+ * reaching a leaf ranked past the limit, or before expanding
+ * a node once the expansions budget or the deadline are
+ * exhausted. In the latter case the visit is truncated, that
+ * is it may have missed some leaves within the rank limit.
+ *
+ * The visit can also be restricted to the leaves of given
+ * categories (see SUBTREE_CATEGORY_MASKS), skipping the
+ * subtries not holding any of them.
+ *
  * Note: this is not a standard-compliant iterator.
  */
-template<typename Node>
+template<typename Node,
+	 template<typename> class Frontier = BinaryHeapFrontier,
+	 typename Prefetch = NoPrefetch>
 class OrderedLeavesIterator
 {
 public:
 
+  /**
+   * Index of the empty labels chain
+   */
+  static constexpr std::size_t no_link =
+    std::numeric_limits<std::size_t>::max ();
+
+  /**
+   * Link of a labels chain. Free slots have a null label and
+   * chain the next free one as parent.
+   */
+  struct PathLink
+  {
+    const std::uint8_t *label;
+    std::size_t size;
+    std::size_t parent;
+    std::size_t refs;
+  };
+
   explicit OrderedLeavesIterator () {}
 
   explicit OrderedLeavesIterator (
     const SiblingsIterator<Node> &siblings_range)
+  {
+    reset (siblings_range);
+  }
+
+  /**
+   * Clear frontier and labels arena. Their storage is retained,
+   * so that a visitor reused across queries stops allocating
+   * once grown to the required size.
+   */
+  void reset ()
+  {
+    m_frontier.clear ();
+    m_links.clear ();
+    m_free_link = no_link;
+    m_retain_links = false;
+    m_precomputed = RankedLeaves<Node> {};
+    m_limits = VisitLimits {};
+    m_expansions = 0;
+    m_stopped = false;
+    m_truncated = false;
+    m_filtered = false;
+  }
+
+  /**
+   * Bound the visit by @p limits, which apply to the ranges
+   * seeded afterwards.
+   */
+  void limit (const VisitLimits &limits)
+  {
+    m_limits = limits;
+  }
+
+  /**
+   * Restrict the visit to the leaves whose category mask
+   * intersects @p mask, in a trie built with @p annotations
+   * flags including SUBTREE_CATEGORY_MASKS. This applies to
+   * the ranges seeded afterwards, together with the end of
+   * the subtrie of their last node.
+   */
+  void filter (const std::uint64_t mask,
+	       const std::uint64_t annotations)
+  {
+    BOOST_ASSERT (annotations & SUBTREE_CATEGORY_MASKS);
+
+    m_filtered = true;
+    m_mask = mask;
+    m_annotations = annotations;
+  }
+
+  /**
+   * Keep every labels chain until reset(), so that the chains
+   * returned by path() remain valid past the leaf they lead to.
+   */
+  void retain_links ()
+  {
+    m_retain_links = true;
+  }
+
+  /**
+   * True if the visit was stopped by the expansions budget
+   * or by the deadline.
+   */
+  bool truncated () const
+  {
+    return m_truncated;
+  }
+
+  /**
+   * Restart the visit from a new siblings range.
+   */
+  void reset (const SiblingsIterator<Node> &siblings_range)
+  {
+    reset ();
+    seed (siblings_range);
+  }
+
+  /**
+   * Extend labels chain @p parent with the label of @p node,
+   * returning index of the new chain, which is kept until
+   * reset().
+   */
+  std::size_t append_link (const Node        &node,
+			   const std::size_t  parent)
+  {
+    const auto link = extend_link (node, parent);
+    acquire (link);
+    return link;
+  }
+
+  /**
+   * Add a siblings range to the visit, where @p path is the
+   * chain of labels spelling the string leading to it and
+   * @p end the end of the subtrie of its last node (only
+   * required by filtered visits).
+   */
+  void seed (const SiblingsIterator<Node> &siblings_range,
+	     const std::size_t             path = no_link,
+	     const std::uint8_t           *end = nullptr)
   {
     if (siblings_range)
     {
-      m_frontier.push (siblings_range);
+      push ({siblings_range, path, end});
       advance_to_leaf ();
     }
   }
 
+  /**
+   * @overload of seed() for a range made of the single node
+   * whose visit reaches first the given @p leaves, in order.
+   * These are served without expanding the frontier.
+   */
+  void seed (const SiblingsIterator<Node> &siblings_range,
+	     const std::size_t             path,
+	     const RankedLeaves<Node>     &leaves)
+  {
+    if (leaves.empty () || !siblings_range || m_filtered)
+    {
+      seed (siblings_range, path);
+      return;
+    }
+
+    m_seed_path = path;
+    m_precomputed = leaves;
+    m_served = 0;
+
+    /*
+     * Stored labels chains are appended once, rooted at the
+     * chain of the seed
+     */
+    m_precomputed_links = m_links.size ();
+
+    for (std::size_t j = 0; j < leaves.links (); ++j)
+    {
+      const auto link = leaves.link (j);
+      const auto parent = precomputed_link (link.parent);
+
+      acquire (parent);
+      m_links.push_back ({link.label, link.size, parent, 0u});
+    }
+
+    load_precomputed ();
+  }
+
+  /**
+   * Continue the visit from current leaf expanding the frontier,
+   * as if no precomputed leaves were given: the frontier is
+   * filled with the leaves not served yet, each as a range of
+   * its own, and with the stored frontier past the last one.
+   */
+  void drop_precomputed ()
+  {
+    if (m_precomputed.empty ())
+    {
+      return;
+    }
+
+    const auto leaves = m_precomputed;
+    m_precomputed = RankedLeaves<Node> {};
+
+    /*
+     * Push by increasing order, as required by monotone
+     * frontiers: the visit reaches every remaining leaf
+     * before the nodes of the stored frontier.
+     */
+    for (auto j = m_served; j < leaves.size (); ++j)
+    {
+      const auto leaf = leaves[j];
+      push ({SiblingsIterator<Node> {leaf, Node::skip (leaf.data ())},
+	     precomputed_link (leaves.path (j))});
+    }
+
+    for (std::size_t j = 0; j < leaves.entries (); ++j)
+    {
+      const auto entry = leaves.entry (j);
+      push ({SiblingsIterator<Node> {entry.node, entry.siblings_end},
+	     precomputed_link (entry.path)});
+    }
+
+    discard_links (m_precomputed_links,
+		   m_precomputed_links + leaves.links ());
+    advance_to_leaf ();
+  }
+
   operator bool () const
   {
-    return !m_frontier.empty ();
+    return !m_stopped &&
+           (!m_precomputed.empty () || !m_frontier.empty ());
   }
 
   auto operator* () const -> const Node&
   {
-    return *(m_frontier.top ());
+    return *(current ().siblings);
   }
 
   auto operator-> () const -> const Node*
   {
-    return &(*(m_frontier.top ()));
+    return &(*(current ().siblings));
+  }
+
+  /**
+   * Chain of labels leading to current leaf
+   */
+  std::size_t path () const
+  {
+    return current ().path;
+  }
+
+  /**
+   * Link at index @p link of the labels arena
+   */
+  const PathLink& link (const std::size_t link) const
+  {
+    return m_links[link];
+  }
+
+  /**
+   * Call @p f on each entry of the frontier, in no given order
+   */
+  template<typename F>
+  void for_each_entry (F &&f) const
+  {
+    m_frontier.for_each (f);
+  }
+
+  /**
+   * Append to @p output the string spelled by labels chain
+   * @p path followed by the label of @p leaf.
+   */
+  template<typename String>
+  void write_string (const std::size_t  path,
+		     const Node        &leaf,
+		     String            &output) const
+  {
+    auto size = static_cast<std::size_t> (leaf.label_size ());
+
+    for (auto link = path; link != no_link;
+	 link = m_links[link].parent)
+    {
+      size += m_links[link].size;
+    }
+
+    output.resize (output.size () + size);
+    auto out = output.end ();
+
+    out = std::copy_backward (
+      leaf.label_begin (),
+      leaf.label_begin () + leaf.label_size (),
+      out);
+
+    for (auto link = path; link != no_link;
+	 link = m_links[link].parent)
+    {
+      const auto &l = m_links[link];
+      out = std::copy_backward (l.label, l.label + l.size, out);
+    }
+  }
+
+  /**
+   * Append to @p output a serialisation of the visit state,
+   * encoding node addresses as offsets from @p base. Only the
+   * labels chains still referred by the frontier are saved.
+   */
+  template<typename Bytes>
+  void save (Bytes &output, const std::uint8_t *base) const
+  {
+    if (!m_precomputed.empty ())
+    {
+      auto expanded = *this;
+      expanded.m_limits = VisitLimits {};
+      expanded.m_stopped = false;
+      expanded.drop_precomputed ();
+      expanded.save (output, base);
+      return;
+    }
+
+    /*
+     * Renumber the reachable links, parents before children:
+     * reused slots do not follow such order.
+     */
+    std::vector<std::size_t> renumbered (m_links.size (), no_link);
+    std::vector<std::size_t> reachable;
+    std::vector<std::size_t> chain;
+    std::size_t entries = 0;
+
+    m_frontier.for_each ([&] (const Entry &entry)
+    {
+      ++entries;
+      chain.clear ();
+
+      for (auto link = entry.path;
+	   (link != no_link) && (renumbered[link] == no_link);
+	   link = m_links[link].parent)
+      {
+	renumbered[link] = 0;
+	chain.push_back (link);
+      }
+
+      for (auto link = chain.rbegin (); link != chain.rend (); ++link)
+      {
+	renumbered[*link] = reachable.size ();
+	reachable.push_back (*link);
+      }
+    });
+
+    const auto links = reachable.size ();
+
+    const auto encode_link = [&] (const std::size_t link)
+    {
+      return (link == no_link) ? 0u : (renumbered[link] + 1);
+    };
+
+    append_varint (output, m_filtered);
+
+    if (m_filtered)
+    {
+      append_varint (output, m_mask);
+    }
+
+    append_varint (output, links);
+
+    for (const auto j : reachable)
+    {
+      append_varint (output, m_links[j].label - base);
+      append_varint (output, m_links[j].size);
+      append_varint (output, encode_link (m_links[j].parent));
+    }
+
+    append_varint (output, entries);
+
+    m_frontier.for_each ([&] (const Entry &entry)
+    {
+      const auto &node = *entry.siblings;
+
+      append_varint (output, node.data () - base);
+      append_varint (output, node.rank ());
+      append_varint (output, node.first_child () - base);
+      append_varint (output, entry.siblings.end_siblings_range () - base);
+      append_varint (output, encode_link (entry.path));
+      append_varint (output, entry.parent_end ?
+		     (entry.parent_end - base + 1) : 0u);
+    });
+  }
+
+  /**
+   * Restore visit state from a serialisation produced by save()
+   * over the trie rooted at @p root, stored up to @p end and
+   * built with @p annotations flags. Advances @p first past the
+   * serialisation. Throws std::invalid_argument on input not
+   * describing a visit of such trie: every labels chain and
+   * frontier entry is matched against the children of the
+   * node of its parent chain, descending from the root.
+   */
+  template<typename InputIt>
+  void restore (InputIt            &first,
+		const InputIt       last,
+		const Node         &root,
+		const std::uint8_t *end,
+		const std::uint64_t annotations = 0)
+  {
+    reset ();
+
+    const auto *base = root.data ();
+    const auto trie_size = static_cast<std::uint64_t> (end - base);
+
+    const auto invalid = []
+    {
+      throw std::invalid_argument ("Cursor not describing a visit");
+    };
+
+    const auto read_offset = [&] (const std::uint64_t limit)
+    {
+      const auto offset = read_varint (first, last);
+
+      if (offset > limit)
+      {
+	throw std::invalid_argument ("Offset out of trie bounds");
+      }
+
+      return offset;
+    };
+
+    const auto read_link = [&] (const std::size_t limit)
+    {
+      const auto link = read_offset (limit);
+      return link ? static_cast<std::size_t> (link - 1) : no_link;
+    };
+
+    if (read_offset (1))
+    {
+      if (!(annotations & SUBTREE_CATEGORY_MASKS))
+      {
+	throw std::invalid_argument ("Trie without category masks");
+      }
+
+      filter (read_varint (first, last), annotations);
+    }
+
+    /*
+     * Internal nodes labelled by the chains, with the end of
+     * their children in filtered visits. Chains without parent
+     * label the root or its children.
+     */
+    struct Parent
+    {
+      Node node;
+      const std::uint8_t *children_end;
+    };
+
+    const auto make_parent = [&] (const Node         &node,
+				  const std::uint8_t *node_end)
+    {
+      if (node.is_leaf ())
+      {
+	invalid ();
+      }
+
+      return Parent {node,
+		     m_filtered ? annotations_begin (node, node_end) : nullptr};
+    };
+
+    std::vector<Parent> parents;
+    boost::optional<Parent> top;
+
+    const auto parent_of = [&] (const std::size_t link) -> const Parent&
+    {
+      if (link != no_link)
+      {
+	return parents[link];
+      }
+
+      if (!top)
+      {
+	top = make_parent (root, end);
+      }
+
+      return *top;
+    };
+
+    /*
+     * Child of @p parent matching @p match, and the end of its
+     * subtrie in filtered visits
+     */
+    const auto locate = [&] (const Parent &parent, const auto &match)
+    {
+      auto child = visit_children (parent.node);
+
+      while (child && !match (*child))
+      {
+	++child;
+      }
+
+      if (!child)
+      {
+	invalid ();
+      }
+
+      auto next = child;
+      ++next;
+
+      return std::make_pair (
+	child,
+	!m_filtered ? nullptr :
+	next ? next->first_child () : parent.children_end);
+    };
+
+    /*
+     * Storage grows as links and entries are read, hence it is
+     * bounded by the size of the input
+     */
+    const auto links = read_varint (first, last);
+
+    for (std::uint64_t j = 0; j < links; ++j)
+    {
+      const auto *label = base + read_offset (trie_size);
+      const auto size = read_offset (trie_size);
+      const auto parent = read_link (j);
+
+      const auto labelled = [&] (const Node &node)
+      {
+	return (node.label_begin () == label) && (node.label_size () == size);
+      };
+
+      if ((parent == no_link) && labelled (root))
+      {
+	parents.push_back (make_parent (root, end));
+      }
+      else
+      {
+	const auto child = locate (parent_of (parent), labelled);
+	parents.push_back (make_parent (*child.first, child.second));
+      }
+
+      acquire (parent);
+      m_links.push_back ({label, static_cast<std::size_t> (size), parent, 0u});
+    }
+
+    const auto entries_count = read_varint (first, last);
+    std::vector<Entry> entries;
+
+    for (std::uint64_t j = 0; j < entries_count; ++j)
+    {
+      const auto *data = base + read_offset (trie_size);
+      const auto rank = read_varint (first, last);
+      const auto children = read_offset (trie_size);
+      const auto *siblings_end = base + read_offset (trie_size);
+      const auto path = read_link (m_links.size ());
+      const auto parent_end = read_offset (trie_size + 1);
+
+      /*
+       * Entries are either the range of the remaining siblings
+       * of a node, or a range made of a single node
+       */
+      Entry entry {SiblingsIterator<Node> {root, Node::skip (base)},
+		   path,
+		   m_filtered ? end : nullptr};
+
+      if ((path != no_link) || (data != base))
+      {
+	const auto &parent = parent_of (path);
+	const auto child = locate (parent, [data] (const Node &node)
+	{
+	  return node.data () == data;
+	});
+
+	if (siblings_end == child.first.end_siblings_range ())
+	{
+	  entry.siblings = child.first;
+	  entry.parent_end = parent.children_end;
+	}
+	else
+	{
+	  entry.siblings = SiblingsIterator<Node>
+	  {
+	    *child.first,
+	    Node::skip (data)
+	  };
+
+	  entry.parent_end = child.second;
+	}
+      }
+
+      const auto &node = *entry.siblings;
+
+      if ((siblings_end != entry.siblings.end_siblings_range ()) ||
+	  (rank != node.rank ()) ||
+	  (children != static_cast<std::uint64_t> (node.first_child () - base)) ||
+	  (parent_end != (entry.parent_end ?
+			  static_cast<std::uint64_t> (entry.parent_end - base + 1) :
+			  0u)))
+      {
+	throw std::invalid_argument ("Inconsistent node state");
+      }
+
+      entries.push_back (entry);
+    }
+
+    /*
+     * Push by increasing order, as required by monotone frontiers
+     */
+    std::sort (entries.begin (), entries.end ());
+
+    for (const auto &entry : entries)
+    {
+      push (entry);
+    }
+
+    discard_links (0, m_links.size ());
+    advance_to_leaf ();
   }
 
   void operator++ ()
   {
+    if (!m_precomputed.empty ())
+    {
+      if (++m_served < m_precomputed.size ())
+      {
+	load_precomputed ();
+      }
+      else
+      {
+	drop_precomputed ();
+      }
+
+      return;
+    }
+
     auto current = m_frontier.top ();
     m_frontier.pop ();
-    ++current;
+    const auto path = current.path;
+    ++current.siblings;
     
-    if (current)
+    if (current.siblings)
     {
-      m_frontier.push (current);
+      push (current);
     }
 
+    release (path);
     advance_to_leaf ();
   }
 
 private:  
 
+  using Entry = FrontierEntry<Node>;
+
+  const Entry& current () const
+  {
+    return m_precomputed.empty () ? m_frontier.top () : m_leaf;
+  }
+
+  /*
+   * Index in the labels arena of stored link @p link
+   */
+  std::size_t precomputed_link (const std::uint64_t link) const
+  {
+    return link ? m_precomputed_links + (link - 1) : m_seed_path;
+  }
+
+  /*
+   * Make current the next precomputed leaf, spelled by its
+   * stored labels chain
+   */
+  void load_precomputed ()
+  {
+    const auto leaf = m_precomputed[m_served];
+
+    m_leaf = {SiblingsIterator<Node> {leaf, Node::skip (leaf.data ())},
+	      precomputed_link (m_precomputed.path (m_served))};
+
+    m_stopped = (leaf.rank () > m_limits.max_rank);
+  }
+
   void advance_to_leaf ()
   {
-    while (static_cast<bool> (*this) &&
-           (!(m_frontier.top ()->is_leaf ())))
+    while (!m_frontier.empty () &&
+           (!(m_frontier.top ().siblings->is_leaf ())))
     {
+      if (!may_expand (m_frontier.top ()))
+      {
+	return;
+      }
+
       auto current = m_frontier.top ();
       m_frontier.pop ();
       push_leftmost_path (current);
+      release (current.path);
+    }
+
+    m_stopped = !m_frontier.empty () &&
+                (m_frontier.top ().rank () > m_limits.max_rank);
+  }
+
+  /*
+   * Check limits before expanding @p entry, stopping the visit
+   * if exceeded. The clock is sampled every few expansions.
+   */
+  bool may_expand (const Entry &entry)
+  {
+    if (entry.rank () > m_limits.max_rank)
+    {
+      m_stopped = true;
+      return false;
     }
+
+    const auto deadline_passed = [&]
+    {
+      return (m_limits.deadline !=
+	      std::chrono::steady_clock::time_point::max ()) &&
+	     ((m_expansions % deadline_period) == 0) &&
+	     (std::chrono::steady_clock::now () >= m_limits.deadline);
+    };
+
+    if ((m_expansions >= m_limits.max_expansions) || deadline_passed ())
+    {
+      m_stopped = true;
+      m_truncated = true;
+      return false;
+    }
+
+    ++m_expansions;
+    return true;
   }
 
-  void push_leftmost_path (SiblingsIterator<Node> visitor)
+  /*
+   * Descend from the node of @p visitor, taken from the
+   * frontier, along the path of first children. In filtered
+   * visits every children range is advanced to the first
+   * node holding leaves of the requested categories.
+   */
+  void push_leftmost_path (Entry visitor)
   {
     while (1)
     {
-      if (visitor->is_leaf ())
+      if (visitor.siblings->is_leaf ())
       {
-	m_frontier.push (visitor);
+	enqueue (visitor);
 	return;
       }
       else
       {
 	auto tail = visitor;
-	++tail;
+	++tail.siblings;
+
+	const auto &node = *visitor.siblings;
+
+	const auto *children_end = m_filtered ?
+	  annotations_begin (node, subtree_end (tail, visitor)) :
+	  nullptr;
 
-	if (tail)
+	if (tail.siblings)
 	{
-	  m_frontier.push (tail);
+	  push (tail);
 	}
 
-	visitor = visit_children (*visitor);
+	visitor.path = extend_link (node, visitor.path);
+	visitor.siblings = visit_children (node);
+	visitor.parent_end = children_end;
+
+	if (m_filtered && !admit (visitor))
+	{
+	  discard (visitor.path);
+	  return;
+	}
       }
     }
   }
 
-private:
+  /*
+   * End of the subtrie of the node of @p entry, given the
+   * range @p next of its following siblings.
+   */
+  static const std::uint8_t* subtree_end (const Entry &next,
+					  const Entry &entry)
+  {
+    return next.siblings ?
+      next.siblings->first_child () : entry.parent_end;
+  }
 
-  using Entry = SiblingsIterator<Node>;
+  /*
+   * Beginning of the annotations of internal @p node whose
+   * subtrie ends at @p end, that is the end of its children.
+   */
+  const std::uint8_t* annotations_begin (const Node         &node,
+					 const std::uint8_t *end) const
+  {
+    read_subtree_summary (node, end, m_annotations);
+    return end;
+  }
 
-  struct OrderByRank
+  /*
+   * Advance @p entry to the first node whose mask intersects
+   * the filter, returning false if there is none.
+   */
+  bool admit (Entry &entry) const
   {
-    bool operator () (const Entry &lhs,
-		      const Entry &rhs) const
+    while (entry.siblings)
     {
-      const auto lhs_rank = lhs->rank ();
-      const auto rhs_rank = rhs->rank ();
+      auto next = entry;
+      ++next.siblings;
+
+      auto end = subtree_end (next, entry);
 
-      if (lhs_rank != rhs_rank)
+      if (read_reversed_varint (end) & m_mask)
       {
-	return lhs_rank > rhs_rank;
+	return true;
       }
 
-      return !(*lhs < *rhs);
+      entry.siblings = next.siblings;
     }
-  };
 
-  std::priority_queue
-  <
-    Entry,
-    std::vector<Entry>,
-    OrderByRank
-  > m_frontier;
+    return false;
+  }
+
+  void push (Entry entry)
+  {
+    if (m_filtered && !admit (entry))
+    {
+      return;
+    }
+
+    enqueue (entry);
+  }
+
+  void enqueue (const Entry &entry)
+  {
+    Prefetch::on_push (*entry.siblings);
+    m_frontier.push (entry);
+    acquire (entry.path);
+  }
+
+  /*
+   * Extend labels chain @p parent with the label of @p node,
+   * in a free slot if any. The new link is unreferenced.
+   */
+  std::size_t extend_link (const Node        &node,
+			   const std::size_t  parent)
+  {
+    acquire (parent);
+
+    const PathLink link {node.label_begin (), node.label_size (), parent, 0u};
+
+    if (m_free_link == no_link)
+    {
+      m_links.push_back (link);
+      return m_links.size () - 1;
+    }
+
+    const auto result = m_free_link;
+    m_free_link = m_links[result].parent;
+    m_links[result] = link;
+
+    return result;
+  }
+
+  void acquire (const std::size_t link)
+  {
+    if (link != no_link)
+    {
+      ++m_links[link].refs;
+    }
+  }
+
+  /*
+   * Drop a reference to @p link, freeing the links of its
+   * chain left unreferenced
+   */
+  void release (std::size_t link)
+  {
+    while ((link != no_link) && !m_retain_links &&
+	   (--m_links[link].refs == 0))
+    {
+      const auto parent = m_links[link].parent;
+      free_link (link);
+      link = parent;
+    }
+  }
+
+  /*
+   * Free @p link if unreferenced
+   */
+  void discard (const std::size_t link)
+  {
+    if ((link != no_link) && !m_retain_links && (m_links[link].refs == 0))
+    {
+      const auto parent = m_links[link].parent;
+      free_link (link);
+      release (parent);
+    }
+  }
+
+  /*
+   * Free the unreferenced links in [@p first, @p last), which
+   * come after their parents in that range
+   */
+  void discard_links (const std::size_t first, std::size_t last)
+  {
+    for (; last != first; --last)
+    {
+      if (m_links[last - 1].label)
+      {
+	discard (last - 1);
+      }
+    }
+  }
+
+  void free_link (const std::size_t link)
+  {
+    m_links[link].label = nullptr;
+    m_links[link].parent = m_free_link;
+    m_free_link = link;
+  }
+
+private:
+
+  Frontier<Entry> m_frontier;
+  std::vector<PathLink> m_links;
+  std::size_t m_free_link = no_link;
+  bool m_retain_links = false;
+
+  static constexpr std::size_t deadline_period = 16;
+
+  RankedLeaves<Node> m_precomputed;
+  std::size_t m_served = 0;
+  std::size_t m_precomputed_links = 0;
+  std::size_t m_seed_path = no_link;
+  Entry m_leaf;
+
+  VisitLimits m_limits;
+  std::size_t m_expansions = 0;
+  bool m_stopped = false;
+  bool m_truncated = false;
+
+  bool m_filtered = false;
+  std::uint64_t m_mask = 0;
+  std::uint64_t m_annotations = 0;
 };
 
-/**
- * Visit downward path to a given descendant calling input
- * functor on each node except source.
- */
+template<typename Node,
+	 template<typename> class Frontier,
+	 typename Prefetch>
+constexpr std::size_t
+OrderedLeavesIterator<Node, Frontier, Prefetch>::no_link;
+
+template<typename Node,
+	 template<typename> class Frontier,
+	 typename Prefetch>
+constexpr std::size_t
+OrderedLeavesIterator<Node, Frontier, Prefetch>::deadline_period;
+
+/***********************************************************/
+
 template<typename Node, typename F>
 void traverse_descending_path (
   Node source,
@@ -0,0 +1,292 @@
+/**
+ * @file  detail/ordered_trie_lexicographic.hpp
+ * @brief Visit of the trie leaves in lexicographic order.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_LEXICOGRAPHIC_HPP
+#define DETAIL_ORDERED_TRIE_LEXICOGRAPHIC_HPP
+
+#include "ordered_trie_iterator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/**
+ * Iterate subtree leaves by increasing lexicographic order of
+ * the string they spell.
+ *
+ * Siblings are stored by increasing rank, hence the children
+ * of every node on the current path are decoded and sorted by
+ * label when the visit enters them. Siblings labels differ in
+ * their first byte, except for the empty label of the leaf
+ * terminating a string, which comes first.
+ *
+ * Note: this is not a standard-compliant iterator.
+ */
+template<typename Node>
+class LexicographicIterator
+{
+public:
+
+  /**
+   * End of the visit
+   */
+  LexicographicIterator () = default;
+
+  /**
+   * Visit all leaves of trie rooted at @p root
+   */
+  explicit LexicographicIterator (const Node &root)
+  {
+    const std::string empty;
+    seek (root, empty.begin (), empty.end (), false);
+  }
+
+  /**
+   * Move to the first leaf spelling a string not lower than
+   * [@p first, @p last) or, if @p strict, greater than it.
+   */
+  template<typename FwdIt>
+  void seek (const Node   &root,
+	     FwdIt         first,
+	     const FwdIt   last,
+	     const bool    strict);
+
+  operator bool () const
+  {
+    return !m_frames.empty ();
+  }
+
+  auto operator* () const -> const Node&
+  {
+    return m_nodes[m_frames.back ().current];
+  }
+
+  auto operator-> () const -> const Node*
+  {
+    return &(**this);
+  }
+
+  /**
+   * Compare position of the visits
+   */
+  bool operator== (const LexicographicIterator &other) const
+  {
+    return current_data () == other.current_data ();
+  }
+
+  void operator++ ()
+  {
+    ++m_frames.back ().current;
+    settle ();
+  }
+
+  /**
+   * Append to @p output the string spelled by current leaf
+   */
+  template<typename String>
+  void write_string (String &output) const
+  {
+    const auto &leaf = **this;
+
+    output.append (m_prefix.begin (), m_prefix.end ());
+    output.append (leaf.label_begin (),
+		   leaf.label_begin () + leaf.label_size ());
+  }
+
+private:
+
+  /*
+   * Children of a node on the current path, stored sorted in
+   * [first, last) of the nodes arena. The labels leading to
+   * them make up the first prefix_size bytes of m_prefix.
+   */
+  struct Frame
+  {
+    std::size_t first;
+    std::size_t last;
+    std::size_t current;
+    std::size_t prefix_size;
+  };
+
+  static unsigned sort_key (const Node &node)
+  {
+    return node.label_size () ? (1u + *node.label_begin ()) : 0u;
+  }
+
+  const std::uint8_t* current_data () const
+  {
+    return *this ? (**this).data () : nullptr;
+  }
+
+  void push_children (const Node &node)
+  {
+    const auto first = m_nodes.size ();
+
+    for (auto it = visit_children (node); it; ++it)
+    {
+      m_nodes.push_back (*it);
+    }
+
+    std::sort (m_nodes.begin () + first, m_nodes.end (),
+	       [] (const Node &lhs, const Node &rhs)
+	       {
+		 return sort_key (lhs) < sort_key (rhs);
+	       });
+
+    m_frames.push_back ({first, m_nodes.size (), first, m_prefix.size ()});
+  }
+
+  void descend (const Node &node)
+  {
+    m_prefix.append (node.label_begin (),
+		     node.label_begin () + node.label_size ());
+
+    push_children (node);
+  }
+
+  /*
+   * Move past exhausted children ranges, then down to the
+   * first leaf of current node.
+   */
+  void settle ()
+  {
+    while (!m_frames.empty () &&
+	   (m_frames.back ().current == m_frames.back ().last))
+    {
+      m_nodes.resize (m_frames.back ().first);
+      m_frames.pop_back ();
+
+      if (!m_frames.empty ())
+      {
+	++m_frames.back ().current;
+      }
+    }
+
+    if (m_frames.empty ())
+    {
+      return;
+    }
+
+    m_prefix.resize (m_frames.back ().prefix_size);
+
+    while (!(**this).is_leaf ())
+    {
+      const auto node = **this;
+      descend (node);
+    }
+  }
+
+private:
+
+  std::vector<Node> m_nodes;
+  std::vector<Frame> m_frames;
+  std::string m_prefix;
+};
+
+/***********************************************************
+ *
+ * ordered_trie_lexicographic.hpp - Inlined implementation
+ *
+ ***********************************************************/
+
+template<typename Node>
+template<typename FwdIt>
+void LexicographicIterator<Node>::seek (const Node  &root,
+					FwdIt        first,
+					const FwdIt  last,
+					const bool   strict)
+{
+  m_nodes.clear ();
+  m_frames.clear ();
+  m_prefix.clear ();
+
+  if (root.is_leaf ())
+  {
+    return;
+  }
+
+  push_children (root);
+
+  /*
+   * Descend along the key while it matches, leaving current the
+   * first node of each range whose subtrie is not lower
+   */
+  while (1)
+  {
+    auto &top = m_frames.back ();
+
+    if (first == last)
+    {
+      if (strict && (sort_key (m_nodes[top.current]) == 0))
+      {
+	++top.current;
+      }
+
+      break;
+    }
+
+    const auto key = 1u + static_cast<std::uint8_t> (*first);
+
+    while ((top.current != top.last) &&
+	   (sort_key (m_nodes[top.current]) < key))
+    {
+      ++top.current;
+    }
+
+    if ((top.current == top.last) ||
+	(sort_key (m_nodes[top.current]) != key))
+    {
+      break;
+    }
+
+    const auto node = m_nodes[top.current];
+    const auto *label = node.label_begin ();
+    const auto *label_end = label + node.label_size ();
+
+    while ((label != label_end) && (first != last) &&
+	   (*label == static_cast<std::uint8_t> (*first)))
+    {
+      ++label;
+      ++first;
+    }
+
+    if (label != label_end)
+    {
+      if ((first != last) && (*label < static_cast<std::uint8_t> (*first)))
+      {
+	++top.current;
+      }
+
+      break;
+    }
+
+    if (node.is_leaf ())
+    {
+      if ((first != last) || strict)
+      {
+	++top.current;
+      }
+
+      break;
+    }
+
+    descend (node);
+  }
+
+  settle ();
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
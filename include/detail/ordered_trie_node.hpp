@@ -13,6 +13,7 @@
 #include "ordered_trie_builtin_serialise.hpp"
 #include "ordered_trie_varint.hpp"
 
+#include <boost/assert.hpp>
 #include <boost/optional.hpp>
 #include <boost/utility/string_ref.hpp>
 #include <boost/range.hpp>
@@ -111,6 +112,62 @@ private:
   const std::uint8_t *m_children = nullptr;
 };
 
+/**
+ * Optional annotations of nodes describing their subtrie.
+ * These are appended to the serialisation of the
+ * subtrie, encoded by append_reversed_varint() in order to be
+ * read backward from its end: this way they are transparent
+ * to the visit of the trie. The end of the subtrie rooted at
+ * a node is the first child of its next sibling or, for the
+ * last sibling, the beginning of the annotations of its
+ * parent (the end of the trie for the root).
+ *
+ * Going backward from the end of the subtrie, the layout is:
+ *
+ * @code
+ * {
+ *    category_mask : varint; // if SUBTREE_CATEGORY_MASKS
+ *    leaf_count    : varint; // if SUBTREE_LEAF_COUNTS
+ *    max_rank      : varint; // if SUBTREE_RANK_RANGES, as
+ *                            // difference from node's rank
+ * };
+ * @endcode
+ *
+ * Leaves only carry their category mask, which makes up their
+ * whole subtrie, while internal nodes carry the union of the
+ * masks of their children.
+ */
+enum SubtreeAnnotation : std::uint64_t
+{
+  SUBTREE_LEAF_COUNTS    = (1 << 0),
+  SUBTREE_RANK_RANGES    = (1 << 1),
+  SUBTREE_CATEGORY_MASKS = (1 << 2)
+};
+
+/**
+ * Decoded subtree annotations. The minimum rank is not stored,
+ * being the rank of any internal node other than the root.
+ */
+struct SubtreeSummary
+{
+  std::uint64_t leaf_count = 0;
+  std::uint64_t min_rank = 0;
+  std::uint64_t max_rank = 0;
+  std::uint64_t category_mask = 0;
+};
+
+/**
+ * Read annotations of internal @p node whose subtrie ends
+ * at @p end, in a trie built with the given @p annotations
+ * flags, moving @p end back to the beginning of them. Fields
+ * not covered by the flags are left to zero, except for the
+ * minimum rank.
+ */
+template<typename Node>
+SubtreeSummary read_subtree_summary (const Node          &node,
+				     const std::uint8_t *&end,
+				     const std::uint64_t  annotations);
+
 /**
  * Serialise node representation from basic components
  */
@@ -304,6 +361,36 @@ const std::uint8_t* Node<T>::first_child () const
 
 /***********************************************************/
 
+template<typename Node>
+SubtreeSummary read_subtree_summary (const Node          &node,
+				     const std::uint8_t *&end,
+				     const std::uint64_t  annotations)
+{
+  BOOST_ASSERT (!node.is_leaf ());
+
+  SubtreeSummary result;
+  result.min_rank = node.rank ();
+
+  if (annotations & SUBTREE_CATEGORY_MASKS)
+  {
+    result.category_mask = read_reversed_varint (end);
+  }
+
+  if (annotations & SUBTREE_LEAF_COUNTS)
+  {
+    result.leaf_count = read_reversed_varint (end);
+  }
+
+  if (annotations & SUBTREE_RANK_RANGES)
+  {
+    result.max_rank = node.rank () + read_reversed_varint (end);
+  }
+
+  return result;
+}
+
+/***********************************************************/
+
 template<typename T>
 void serialise_node (std::vector<std::uint8_t> &output,
 		     const std::string         &label,
@@ -0,0 +1,341 @@
+/**
+ * @file  detail/ordered_trie_parallel.hpp
+ * @brief Work stealing pool of threads processing the positions
+ *        of an input range, and partitioning of the trie into
+ *        subtries processed apart.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_PARALLEL_HPP
+#define DETAIL_ORDERED_TRIE_PARALLEL_HPP
+
+#include "ordered_trie_iterator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/**
+ * Number of input prefixes taken at once by a worker of
+ * parallel queries
+ */
+constexpr std::size_t parallel_grain = 256;
+
+/**
+ * Number of workers to run for @p threads threads (0 for one
+ * per hardware thread) over @p count positions taken by chunks
+ * of @p grain
+ */
+inline std::size_t worker_count (const std::size_t threads,
+				 const std::size_t count,
+				 const std::size_t grain)
+{
+  const auto wanted = threads ? threads :
+    std::max<std::size_t> (std::thread::hardware_concurrency (), 1);
+
+  const auto chunks = (count + grain - 1) / grain;
+
+  return std::max<std::size_t> (std::min (wanted, chunks), 1);
+}
+
+/**
+ * Positions [0, count) split into a range per worker. A worker
+ * takes chunks from the front of its own range and, once it is
+ * exhausted, steals the back half of the range of another one.
+ */
+class WorkStealingRanges
+{
+public:
+
+  WorkStealingRanges (const std::size_t count,
+		      const std::size_t workers,
+		      const std::size_t grain)
+    : m_ranges (new Range[workers])
+    , m_workers (workers)
+    , m_grain (grain)
+  {
+    for (std::size_t w = 0; w < workers; ++w)
+    {
+      m_ranges[w].first = count * w / workers;
+      m_ranges[w].last = count * (w + 1) / workers;
+    }
+  }
+
+  /**
+   * Take into @p chunk the next positions to be processed by
+   * @p worker. Returns false once every range is exhausted, or
+   * after cancel().
+   */
+  bool next (const std::size_t worker, std::pair<std::size_t, std::size_t> &chunk);
+
+  /**
+   * Stop handing out positions
+   */
+  void cancel ()
+  {
+    m_cancelled = true;
+  }
+
+private:
+
+  /*
+   * Ranges are padded apart, so that workers do not contend
+   * while taking from their own ones
+   */
+  struct Range
+  {
+    std::mutex mutex;
+    std::size_t first = 0;
+    std::size_t last = 0;
+    char padding[64];
+  };
+
+  std::unique_ptr<Range[]> m_ranges;
+  std::size_t m_workers;
+  std::size_t m_grain;
+  std::atomic<bool> m_cancelled {false};
+};
+
+/**
+ * Call @p process (worker, first, last) on chunks of up to
+ * @p grain positions [0, @p count) from @p workers threads, the
+ * calling one being worker 0, until every position is
+ * processed. The first exception thrown by @p process stops the
+ * other workers and is rethrown once they are over.
+ */
+template<typename F>
+void run_work_stealing (const std::size_t  count,
+			const std::size_t  workers,
+			const std::size_t  grain,
+			F                 &&process);
+
+/**
+ * Split the trie rooted at @p root into the subtries of its
+ * nodes @p depth levels below, and the leaves above them. Each
+ * part is paired with the string spelled by the ancestors of
+ * its node, and parts are listed by increasing lexicographic
+ * order of such strings: hence, their strings are too.
+ */
+template<typename Node>
+auto partition_subtries (const Node        &root,
+			 const std::size_t  depth)
+  -> std::vector<std::pair<Node, std::string>>;
+
+/***********************************************************
+ *
+ * ordered_trie_parallel.hpp - Inlined implementation
+ *
+ ***********************************************************/
+
+inline bool WorkStealingRanges::next (
+  const std::size_t                      worker,
+  std::pair<std::size_t, std::size_t>   &chunk)
+{
+  auto &own = m_ranges[worker];
+
+  while (!m_cancelled)
+  {
+    {
+      std::lock_guard<std::mutex> lock {own.mutex};
+
+      if (own.first != own.last)
+      {
+	chunk.first = own.first;
+	chunk.second = std::min (own.last, own.first + m_grain);
+	own.first = chunk.second;
+	return true;
+      }
+    }
+
+    /*
+     * Steal from the other workers in turn, ending when all
+     * of them are found exhausted
+     */
+    std::pair<std::size_t, std::size_t> stolen {0, 0};
+
+    for (std::size_t j = 1; (j < m_workers) && (stolen.first == stolen.second); ++j)
+    {
+      auto &victim = m_ranges[(worker + j) % m_workers];
+      std::lock_guard<std::mutex> lock {victim.mutex};
+
+      const auto left = victim.last - victim.first;
+
+      if (left == 0)
+      {
+	continue;
+      }
+
+      const auto middle = (left <= m_grain) ?
+	victim.first : victim.first + left / 2;
+
+      stolen = std::make_pair (middle, victim.last);
+      victim.last = middle;
+    }
+
+    if (stolen.first == stolen.second)
+    {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock {own.mutex};
+    own.first = stolen.first;
+    own.last = stolen.second;
+  }
+
+  return false;
+}
+
+/***********************************************************/
+
+template<typename F>
+void run_work_stealing (const std::size_t  count,
+			const std::size_t  workers,
+			const std::size_t  grain,
+			F                 &&process)
+{
+  WorkStealingRanges ranges {count, workers, grain};
+
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  const auto work = [&] (const std::size_t worker)
+  {
+    try
+    {
+      std::pair<std::size_t, std::size_t> chunk;
+
+      while (ranges.next (worker, chunk))
+      {
+	process (worker, chunk.first, chunk.second);
+      }
+    }
+    catch (...)
+    {
+      ranges.cancel ();
+
+      std::lock_guard<std::mutex> lock {error_mutex};
+
+      if (!error)
+      {
+	error = std::current_exception ();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve (workers - 1);
+
+  try
+  {
+    for (std::size_t w = 1; w < workers; ++w)
+    {
+      threads.emplace_back (work, w);
+    }
+  }
+  catch (...)
+  {
+    ranges.cancel ();
+
+    for (auto &thread : threads)
+    {
+      thread.join ();
+    }
+
+    throw;
+  }
+
+  work (0);
+
+  for (auto &thread : threads)
+  {
+    thread.join ();
+  }
+
+  if (error)
+  {
+    std::rethrow_exception (error);
+  }
+}
+
+/***********************************************************/
+
+template<typename Node>
+auto partition_subtries (const Node        &root,
+			 const std::size_t  depth)
+  -> std::vector<std::pair<Node, std::string>>
+{
+  std::vector<std::pair<Node, std::string>> result;
+
+  /*
+   * Depth first visit pushing children in reverse lexicographic
+   * order, the empty label of a terminating leaf coming first
+   */
+  struct Frame
+  {
+    Node node;
+    std::string head;
+    std::size_t level;
+  };
+
+  std::vector<Frame> stack {{root, std::string {}, 0}};
+  std::vector<Node> children;
+
+  while (!stack.empty ())
+  {
+    auto frame = std::move (stack.back ());
+    stack.pop_back ();
+
+    if (frame.node.is_leaf () || (frame.level == depth))
+    {
+      result.emplace_back (frame.node, std::move (frame.head));
+      continue;
+    }
+
+    const auto &node = frame.node;
+    frame.head.append (node.label_begin (),
+		       node.label_begin () + node.label_size ());
+
+    children.clear ();
+
+    for (auto it = visit_children (node); it; ++it)
+    {
+      children.push_back (*it);
+    }
+
+    std::sort (children.begin (), children.end (),
+	       [] (const Node &lhs, const Node &rhs)
+	       {
+		 const auto key = [] (const Node &n)
+		 {
+		   return n.label_size () ? (1u + *n.label_begin ()) : 0u;
+		 };
+
+		 return key (lhs) > key (rhs);
+	       });
+
+    for (const auto &child : children)
+    {
+      stack.push_back ({child, frame.head, frame.level + 1});
+    }
+  }
+
+  return result;
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * @file  detail/ordered_trie_pattern.hpp
+ * @brief Matching of glob patterns against the trie.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_PATTERN_HPP
+#define DETAIL_ORDERED_TRIE_PATTERN_HPP
+
+#include "ordered_trie_iterator.hpp"
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ordered_trie {
+namespace detail {
+
+/**
+ * Glob pattern compiled to a non deterministic automaton,
+ * whose set of states is simulated as a bit mask.
+ *
+ * The pattern is a sequence of:
+ * - '?', matching any byte;
+ * - '*', matching any sequence of bytes;
+ * - '[...]', matching any byte of the class, made up of bytes
+ *   and ranges 'a-z', negated if starting by '!' or '^';
+ * - '\\c', matching the byte c;
+ * - any other byte, matching itself.
+ *
+ * State j means the first j elements of the pattern have been
+ * matched.
+ */
+class GlobPattern
+{
+public:
+
+  using States = std::uint64_t;
+
+  /**
+   * Maximum number of elements of a pattern
+   */
+  static constexpr std::size_t max_size = 63;
+
+  /**
+   * Compile @p pattern. Throws std::invalid_argument if it is
+   * malformed or longer than max_size elements.
+   */
+  explicit GlobPattern (const std::string &pattern);
+
+  /**
+   * States before reading any byte
+   */
+  States initial () const
+  {
+    return closure (1);
+  }
+
+  /**
+   * States reached from @p states reading @p byte
+   */
+  States step (const States states, const std::uint8_t byte) const
+  {
+    const auto matched = states & m_matches[byte];
+    return closure ((matched & m_stars) | ((matched & ~m_stars) << 1));
+  }
+
+  /**
+   * Whether @p states accept the string read so far
+   */
+  bool accepts (const States states) const
+  {
+    return states & m_final;
+  }
+
+  /**
+   * Whether @p states accept any continuation of the string
+   * read so far
+   */
+  bool accepts_all (const States states) const
+  {
+    return states & m_universal;
+  }
+
+private:
+
+  /*
+   * Add states reachable by matching empty sequences with '*'
+   */
+  States closure (States states) const
+  {
+    while (1)
+    {
+      const auto next = states | ((states & m_stars) << 1);
+
+      if (next == states)
+      {
+	return states;
+      }
+
+      states = next;
+    }
+  }
+
+  std::array<States, 256> m_matches {};
+  States m_stars = 0;
+  States m_final = 0;
+  States m_universal = 0;
+};
+
+/**
+ * Find the topmost nodes whose subtries hold only strings
+ * matching @p pattern, together with the leaves of the strings
+ * matching it elsewhere.
+ *
+ * The trie is visited depth first carrying the states of the
+ * automaton after reading the string spelled so far, pruning
+ * the subtries as soon as no state is left.
+ *
+ * Returns the matching nodes paired with the chain of labels
+ * leading to them, built by mean of @p visitor.
+ */
+template<typename Node, typename Visitor>
+auto glob_pattern_loci (const Node        &root,
+			const GlobPattern &pattern,
+			Visitor           &visitor)
+  -> std::vector<std::pair<Node, std::size_t>>
+{
+  std::vector<std::pair<Node, std::size_t>> result;
+  const auto initial = pattern.initial ();
+
+  if (pattern.accepts_all (initial))
+  {
+    result.emplace_back (root, visitor.no_link);
+    return result;
+  }
+
+  if (root.is_leaf ())
+  {
+    return result;
+  }
+
+  struct Frame
+  {
+    SiblingsIterator<Node> children;
+    std::size_t path;
+    GlobPattern::States states;
+  };
+
+  std::vector<Frame> stack {{visit_children (root), visitor.no_link, initial}};
+
+  while (!stack.empty ())
+  {
+    auto &top = stack.back ();
+
+    if (!top.children)
+    {
+      stack.pop_back ();
+      continue;
+    }
+
+    const auto node = *top.children;
+    const auto path = top.path;
+    auto states = top.states;
+    ++top.children;
+
+    for (auto label = node.label_begin ();
+	 states && (label != node.label_begin () + node.label_size ());
+	 ++label)
+    {
+      states = pattern.step (states, *label);
+    }
+
+    if (pattern.accepts_all (states) ||
+	(node.is_leaf () && pattern.accepts (states)))
+    {
+      result.emplace_back (node, path);
+    }
+    else if (states && !node.is_leaf ())
+    {
+      stack.push_back ({visit_children (node),
+			visitor.append_link (node, path),
+			states});
+    }
+  }
+
+  return result;
+}
+
+/***********************************************************
+ *
+ * ordered_trie_pattern.hpp - Inlined implementation
+ *
+ ***********************************************************/
+
+inline GlobPattern::GlobPattern (const std::string &pattern)
+{
+  std::vector<std::pair<std::bitset<256>, bool>> elements;
+
+  for (auto it = pattern.begin (); it != pattern.end (); ++it)
+  {
+    std::bitset<256> bytes;
+    bool star = false;
+
+    switch (*it)
+    {
+    case '*':
+      star = true;
+      // Fall through
+    case '?':
+      bytes.set ();
+      break;
+
+    case '\\':
+      if (++it == pattern.end ())
+      {
+	throw std::invalid_argument ("Trailing escape in pattern");
+      }
+
+      bytes.set (static_cast<std::uint8_t> (*it));
+      break;
+
+    case '[':
+    {
+      const auto negated = (it + 1 != pattern.end ()) &&
+	((it[1] == '!') || (it[1] == '^'));
+
+      const auto first = it + (negated ? 2 : 1);
+      auto last = first;
+
+      for (; (last != pattern.end ()) && ((*last != ']') || (last == first));
+	   ++last)
+      {
+      }
+
+      if (last == pattern.end ())
+      {
+	throw std::invalid_argument ("Unterminated class in pattern");
+      }
+
+      for (auto c = first; c != last; ++c)
+      {
+	const auto lo = static_cast<std::uint8_t> (*c);
+
+	if ((c + 2 < last) && (c[1] == '-'))
+	{
+	  const auto hi = static_cast<std::uint8_t> (c[2]);
+
+	  for (unsigned b = lo; b <= hi; ++b)
+	  {
+	    bytes.set (b);
+	  }
+
+	  c += 2;
+	}
+	else
+	{
+	  bytes.set (lo);
+	}
+      }
+
+      if (negated)
+      {
+	bytes.flip ();
+      }
+
+      it = last;
+      break;
+    }
+
+    default:
+      bytes.set (static_cast<std::uint8_t> (*it));
+    }
+
+    if (star && !elements.empty () && elements.back ().second)
+    {
+      continue;
+    }
+
+    elements.emplace_back (bytes, star);
+  }
+
+  if (elements.size () > max_size)
+  {
+    throw std::invalid_argument ("Pattern too long");
+  }
+
+  const auto n = elements.size ();
+
+  for (std::size_t j = 0; j < n; ++j)
+  {
+    for (unsigned b = 0; b < 256; ++b)
+    {
+      if (elements[j].first[b])
+      {
+	m_matches[b] |= States {1} << j;
+      }
+    }
+
+    if (elements[j].second)
+    {
+      m_stars |= States {1} << j;
+    }
+  }
+
+  m_final = States {1} << n;
+
+  /*
+   * Any continuation is accepted from the states followed
+   * only by a non empty run of '*'
+   */
+  for (auto j = n; (j > 0) && elements[j - 1].second; --j)
+  {
+    m_universal |= States {1} << (j - 1);
+  }
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
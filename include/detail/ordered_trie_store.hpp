@@ -43,12 +43,20 @@ public:
     -> std::shared_ptr<const Store>;
 
   /**
-   * Instantiate from trie serialisation and optional
-   * score indirection table
+   * Instantiate from trie serialisation, optional score
+   * indirection table, SubtreeAnnotation flags describing
+   * the annotations contained in the trie serialisation,
+   * optional top-k index (see ordered_trie_top_k.hpp),
+   * optional companion tries (see ordered_trie_companion.hpp)
+   * and optional filter (see ordered_trie_filter.hpp).
    */
   static auto from_memory (
     std::vector<std::uint8_t> serialised_trie,
-    std::vector<std::uint8_t> serialised_score_table = {})
+    std::vector<std::uint8_t> serialised_score_table = {},
+    const std::uint64_t       annotations = 0,
+    std::vector<std::uint8_t> serialised_top_k = {},
+    std::vector<std::uint8_t> serialised_companions = {},
+    std::vector<std::uint8_t> serialised_filter = {})
     -> std::shared_ptr<const Store>;
   
   /**
@@ -71,6 +79,35 @@ public:
     -> std::pair<const std::uint8_t *,
                  const std::uint8_t *>;
 
+  /**
+   * Get pointer to hosted top-k index serialisation
+   * (or nullptr if absent).
+   */
+  auto top_k_data () const
+    -> std::pair<const std::uint8_t *,
+                 const std::uint8_t *>;
+
+  /**
+   * Get pointer to hosted companion tries serialisation
+   * (or nullptr if absent).
+   */
+  auto companions_data () const
+    -> std::pair<const std::uint8_t *,
+                 const std::uint8_t *>;
+
+  /**
+   * Get pointer to hosted filter serialisation
+   * (or nullptr if absent).
+   */
+  auto filter_data () const
+    -> std::pair<const std::uint8_t *,
+                 const std::uint8_t *>;
+
+  /**
+   * SubtreeAnnotation flags of hosted trie serialisation
+   */
+  std::uint64_t annotations () const;
+
   /**
    * Not-copyable or assignable
    */
@@ -94,6 +131,10 @@ private:
   // @TODO: allow to memory-map the content of this store
   std::vector<std::uint8_t> m_serialised_trie;
   std::vector<std::uint8_t> m_serialised_score_table;
+  std::vector<std::uint8_t> m_serialised_top_k;
+  std::vector<std::uint8_t> m_serialised_companions;
+  std::vector<std::uint8_t> m_serialised_filter;
+  std::uint64_t m_annotations = 0;
 };
 
 /*****************************************************************/
@@ -177,6 +218,30 @@ struct Header
    */
   std::pair<std::uint64_t, std::uint64_t>
   trie_segment = std::make_pair (0, 0);
+
+  /*
+   * SubtreeAnnotation flags of the trie (since release 1.1)
+   */
+  std::uint64_t annotations = 0;
+
+  /*
+   * Top-k index offset in file (0 if absent, since release 1.2)
+   */
+  std::pair<std::uint64_t, std::uint64_t>
+  top_k_segment = std::make_pair (0, 0);
+
+  /*
+   * Companion tries offset in file (0 if absent, since
+   * release 1.3)
+   */
+  std::pair<std::uint64_t, std::uint64_t>
+  companions_segment = std::make_pair (0, 0);
+
+  /*
+   * Filter offset in file (0 if absent, since release 1.4)
+   */
+  std::pair<std::uint64_t, std::uint64_t>
+  filter_segment = std::make_pair (0, 0);
 };
   
 /*****************************************************************/
@@ -206,6 +271,13 @@ void serialise (std::vector<std::uint8_t> &out,
   serialise (out, header.score_table_segment.second);
   serialise (out, header.trie_segment.first);
   serialise (out, header.trie_segment.second);
+  serialise (out, header.annotations);
+  serialise (out, header.top_k_segment.first);
+  serialise (out, header.top_k_segment.second);
+  serialise (out, header.companions_segment.first);
+  serialise (out, header.companions_segment.second);
+  serialise (out, header.filter_segment.first);
+  serialise (out, header.filter_segment.second);
 }
 
 template<typename Parameters>
@@ -220,6 +292,17 @@ size_t serialised_header_size ()
 
   return result;
 }
+
+/*
+ * Size of the header fields written by release 1.0, which
+ * later releases only extend.
+ */
+template<typename Parameters>
+size_t serialised_base_header_size ()
+{
+  return serialised_header_size<Parameters> () -
+         7 * sizeof (std::uint64_t);
+}
   
 template<typename Parameters>
 void put_header (std::ostream &os, const Header<Parameters> &header)
@@ -242,10 +325,10 @@ auto get_header (std::istream &binary_stream)
   -> Header<Parameters>
 {
   /*
-   * Read header (payload excluded)
+   * Read header fields common to all releases
    */
   std::vector<std::uint8_t> buffer (
-    serialised_header_size<Parameters> (), 0);
+    serialised_base_header_size<Parameters> (), 0);
 
   binary_stream.read (reinterpret_cast<char *> (buffer.data ()),
 		      buffer.size ());
@@ -302,6 +385,51 @@ auto get_header (std::istream &binary_stream)
   result.trie_segment.second = deserialise<size_t> (& (*p));
   p += sizeof (size_t);
 
+  /*
+   * Read extension fields of the release of the file
+   */
+  const auto read_extension = [&binary_stream] ()
+  {
+    std::uint8_t extension[sizeof (std::uint64_t)];
+    binary_stream.read (reinterpret_cast<char *> (extension),
+			sizeof (extension));
+
+    if (!binary_stream)
+    {
+      throw std::logic_error ("Error reading file header");
+    }
+
+    return deserialise<std::uint64_t> (extension);
+  };
+
+  result.annotations = 0;
+  result.top_k_segment = std::make_pair (0, 0);
+  result.companions_segment = std::make_pair (0, 0);
+  result.filter_segment = std::make_pair (0, 0);
+
+  if (result.major_number == 1 && result.minor_number >= 1)
+  {
+    result.annotations = read_extension ();
+  }
+
+  if (result.major_number == 1 && result.minor_number >= 2)
+  {
+    result.top_k_segment.first = read_extension ();
+    result.top_k_segment.second = read_extension ();
+  }
+
+  if (result.major_number == 1 && result.minor_number >= 3)
+  {
+    result.companions_segment.first = read_extension ();
+    result.companions_segment.second = read_extension ();
+  }
+
+  if (result.major_number == 1 && result.minor_number >= 4)
+  {
+    result.filter_segment.first = read_extension ();
+    result.filter_segment.second = read_extension ();
+  }
+
   return result;
 }
 
@@ -311,13 +439,17 @@ template<typename Parameters>
 auto Store<Parameters>::release_number ()
  -> std::tuple <std::uint32_t, std::uint32_t, std::uint32_t>
 {
-  return std::make_tuple (1, 0, 0);
+  return std::make_tuple (1, 4, 0);
 }
 
 template<typename Parameters>
 auto Store<Parameters>::from_memory (
   std::vector<std::uint8_t> serialised_trie,
-  std::vector<std::uint8_t> serialised_score_table)
+  std::vector<std::uint8_t> serialised_score_table,
+  const std::uint64_t       annotations,
+  std::vector<std::uint8_t> serialised_top_k,
+  std::vector<std::uint8_t> serialised_companions,
+  std::vector<std::uint8_t> serialised_filter)
 -> std::shared_ptr<const Store<Parameters>>
 {
   std::shared_ptr<Store<Parameters>> result
@@ -325,6 +457,10 @@ auto Store<Parameters>::from_memory (
 
   result->m_serialised_trie = std::move (serialised_trie);
   result->m_serialised_score_table = std::move (serialised_score_table);
+  result->m_annotations = annotations;
+  result->m_serialised_top_k = std::move (serialised_top_k);
+  result->m_serialised_companions = std::move (serialised_companions);
+  result->m_serialised_filter = std::move (serialised_filter);
 
   return result;
 }
@@ -335,6 +471,9 @@ auto Store<Parameters>::from_file (const std::string &path)
 {
   std::vector<std::uint8_t> serialised_score_table;
   std::vector<std::uint8_t> serialised_trie;  
+  std::vector<std::uint8_t> serialised_top_k;
+  std::vector<std::uint8_t> serialised_companions;
+  std::vector<std::uint8_t> serialised_filter;
 
   std::ifstream fin (path, std::ios_base::in |
 		           std::ios_base::binary);
@@ -391,9 +530,52 @@ auto Store<Parameters>::from_file (const std::string &path)
   fin.read (
     reinterpret_cast<char *> (serialised_trie.data ()),
     serialised_trie.size ());
+
+  /*
+   * Read top-k index segment
+   */
+  if (header.top_k_segment.first)
+  {
+    fin.seekg (header.top_k_segment.first, std::ios_base::beg);
+    serialised_top_k.resize (header.top_k_segment.second);
+
+    fin.read (
+      reinterpret_cast<char *> (serialised_top_k.data ()),
+      serialised_top_k.size ());
+  }
+
+  /*
+   * Read companion tries segment
+   */
+  if (header.companions_segment.first)
+  {
+    fin.seekg (header.companions_segment.first, std::ios_base::beg);
+    serialised_companions.resize (header.companions_segment.second);
+
+    fin.read (
+      reinterpret_cast<char *> (serialised_companions.data ()),
+      serialised_companions.size ());
+  }
+
+  /*
+   * Read filter segment
+   */
+  if (header.filter_segment.first)
+  {
+    fin.seekg (header.filter_segment.first, std::ios_base::beg);
+    serialised_filter.resize (header.filter_segment.second);
+
+    fin.read (
+      reinterpret_cast<char *> (serialised_filter.data ()),
+      serialised_filter.size ());
+  }
   
   return from_memory (std::move (serialised_trie),
-		      std::move (serialised_score_table));
+		      std::move (serialised_score_table),
+		      header.annotations,
+		      std::move (serialised_top_k),
+		      std::move (serialised_companions),
+		      std::move (serialised_filter));
 }
   
 template<typename Parameters>
@@ -423,6 +605,33 @@ void Store<Parameters>::write (const std::string &path) const
       header_size + m_serialised_score_table.size (),
       m_serialised_trie.size ());
 
+    result.annotations = m_annotations;
+
+    if (!m_serialised_top_k.empty ())
+    {
+      result.top_k_segment = std::make_pair (
+	header_size + m_serialised_score_table.size () +
+	m_serialised_trie.size (),
+	m_serialised_top_k.size ());
+    }
+
+    if (!m_serialised_companions.empty ())
+    {
+      result.companions_segment = std::make_pair (
+	header_size + m_serialised_score_table.size () +
+	m_serialised_trie.size () + m_serialised_top_k.size (),
+	m_serialised_companions.size ());
+    }
+
+    if (!m_serialised_filter.empty ())
+    {
+      result.filter_segment = std::make_pair (
+	header_size + m_serialised_score_table.size () +
+	m_serialised_trie.size () + m_serialised_top_k.size () +
+	m_serialised_companions.size (),
+	m_serialised_filter.size ());
+    }
+
     return result;
   } ();
   
@@ -444,6 +653,30 @@ void Store<Parameters>::write (const std::string &path) const
       m_serialised_trie.data ()),
     m_serialised_trie.size ());
 
+  if (!m_serialised_top_k.empty ())
+  {
+    fout.write (
+      reinterpret_cast<const char *> (
+	m_serialised_top_k.data ()),
+      m_serialised_top_k.size ());
+  }
+
+  if (!m_serialised_companions.empty ())
+  {
+    fout.write (
+      reinterpret_cast<const char *> (
+	m_serialised_companions.data ()),
+      m_serialised_companions.size ());
+  }
+
+  if (!m_serialised_filter.empty ())
+  {
+    fout.write (
+      reinterpret_cast<const char *> (
+	m_serialised_filter.data ()),
+      m_serialised_filter.size ());
+  }
+
   if (!fout)
   {
     throw std::runtime_error ("Error writing to file");
@@ -461,6 +694,45 @@ auto Store<Parameters>::trie_data () const
  		     &(m_serialised_trie.back ()) + 1);
 }
 
+template<typename Parameters>
+auto Store<Parameters>::top_k_data () const
+  -> std::pair<const std::uint8_t*,
+               const std::uint8_t*>
+{
+  return m_serialised_top_k.empty () ?
+      std::make_pair (nullptr, nullptr)
+    : std::make_pair (m_serialised_top_k.data (),
+		      &(m_serialised_top_k.back ()) + 1);
+}
+
+template<typename Parameters>
+auto Store<Parameters>::companions_data () const
+  -> std::pair<const std::uint8_t*,
+               const std::uint8_t*>
+{
+  return m_serialised_companions.empty () ?
+      std::make_pair (nullptr, nullptr)
+    : std::make_pair (m_serialised_companions.data (),
+		      &(m_serialised_companions.back ()) + 1);
+}
+
+template<typename Parameters>
+auto Store<Parameters>::filter_data () const
+  -> std::pair<const std::uint8_t*,
+               const std::uint8_t*>
+{
+  return m_serialised_filter.empty () ?
+      std::make_pair (nullptr, nullptr)
+    : std::make_pair (m_serialised_filter.data (),
+		      &(m_serialised_filter.back ()) + 1);
+}
+
+template<typename Parameters>
+std::uint64_t Store<Parameters>::annotations () const
+{
+  return m_annotations;
+}
+
 template<typename Parameters>
 auto Store<Parameters>::score_table_data () const
   -> std::pair<const std::uint8_t*,
@@ -0,0 +1,530 @@
+/**
+ * @file  detail/ordered_trie_top_k.hpp
+ * @brief Precomputed best leaves of the heaviest subtries.
+ *
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE.txt', which is part of this source code package.
+ *
+ */
+
+#ifndef DETAIL_ORDERED_TRIE_TOP_K_HPP
+#define DETAIL_ORDERED_TRIE_TOP_K_HPP
+
+#include "ordered_trie_builtin_serialise.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace ordered_trie {
+namespace detail {
+
+/*
+ * The top-k index is a sequence of 64 bit words listing, for
+ * the internal nodes whose subtrie holds more leaves than a
+ * given threshold, the first leaves reached by the ordered
+ * visit of the subtrie, and the state of the visit past them:
+ *
+ * @code
+ * {
+ *    nodes_count : word;
+ *    nodes       : {offset : word; first_leaf : word}[nodes_count];
+ *    leaves_count : word;
+ *    leaves      : {offset : word;
+ *                   rank : word;
+ *                   first_child : word}[leaves_count];
+ *    states      : word[nodes_count];   // offset of each state
+ *    state       : {links_count   : word;
+ *                   links         : {label : word;
+ *                                    size : word;
+ *                                    parent : word}[links_count];
+ *                   paths         : word[leaves of the node];
+ *                   entries_count : word;
+ *                   entries       : {node : word;
+ *                                    rank : word;
+ *                                    first_child : word;
+ *                                    siblings_end : word;
+ *                                    path : word}[entries_count];
+ *                  }[nodes_count];
+ * };
+ * @endcode
+ *
+ * Nodes are sorted by increasing offset in the trie, and the
+ * leaves of a node extend up to the first leaf of the next one
+ * (or leaves_count for the last node).
+ *
+ * The state of a node holds the chains of labels leading from
+ * the node (included) to its leaves, and the frontier of the
+ * visit once they are reached, as OrderedLeavesIterator::save()
+ * does: links refer to their parent by 1 + its index (0 for
+ * none), states by word offset from the index begin.
+ */
+
+/**
+ * Link of a labels chain stored in a top-k index
+ */
+struct PrecomputedLink
+{
+  const std::uint8_t *label;
+  std::size_t size;
+  std::uint64_t parent;
+};
+
+/**
+ * Frontier entry stored in a top-k index
+ */
+template<typename Node>
+struct PrecomputedEntry
+{
+  Node node;
+  const std::uint8_t *siblings_end;
+  std::uint64_t path;
+};
+
+/**
+ * Node stored at @p offset in the trie from @p trie, given
+ * its rank and children address (as offset from @p trie)
+ */
+template<typename Node>
+Node decode_node (const std::uint8_t  *trie,
+		  const std::uint64_t  offset,
+		  const std::uint64_t  rank,
+		  const std::uint64_t  children);
+
+/**
+ * View over the sequence of precomputed leaves of a subtrie,
+ * and over the state of its visit past them.
+ */
+template<typename Node>
+class RankedLeaves
+{
+public:
+
+  RankedLeaves () = default;
+
+  explicit RankedLeaves (const std::uint8_t *first,
+			 const std::uint8_t *last,
+			 const std::uint8_t *trie,
+			 const std::uint8_t *state)
+    : m_first (first)
+    , m_last (last)
+    , m_trie (trie)
+    , m_state (state)
+  {
+  }
+
+  /**
+   * Number of links of the stored labels chains
+   */
+  std::size_t links () const
+  {
+    return state_word (0);
+  }
+
+  PrecomputedLink link (const std::size_t j) const
+  {
+    return PrecomputedLink
+    {
+      m_trie + state_word (1 + 3 * j),
+      static_cast<std::size_t> (state_word (2 + 3 * j)),
+      state_word (3 + 3 * j)
+    };
+  }
+
+  /**
+   * Labels chain leading to leaf at position @p j
+   */
+  std::uint64_t path (const std::size_t j) const
+  {
+    return state_word (1 + 3 * links () + j);
+  }
+
+  /**
+   * Number of frontier entries past the leaves
+   */
+  std::size_t entries () const
+  {
+    return state_word (1 + 3 * links () + size ());
+  }
+
+  PrecomputedEntry<Node> entry (const std::size_t j) const;
+
+  std::size_t size () const
+  {
+    return (m_last - m_first) / entry_size;
+  }
+
+  bool empty () const
+  {
+    return m_first == m_last;
+  }
+
+  /**
+   * Leaf at position @p j
+   */
+  Node operator[] (const std::size_t j) const
+  {
+    const auto *entry = m_first + j * entry_size;
+
+    return decode_node<Node> (m_trie,
+			      word (entry, 0),
+			      word (entry, 1),
+			      word (entry, 2));
+  }
+
+private:
+
+  static constexpr std::size_t word_size = sizeof (std::uint64_t);
+  static constexpr std::size_t entry_size = 3 * word_size;
+
+  static std::uint64_t word (const std::uint8_t *first,
+			     const std::size_t   j)
+  {
+    return ordered_trie::deserialise<std::uint64_t> (
+      first + j * word_size);
+  }
+
+  std::uint64_t state_word (const std::size_t j) const
+  {
+    return word (m_state, j);
+  }
+
+  const std::uint8_t *m_first = nullptr;
+  const std::uint8_t *m_last = nullptr;
+  const std::uint8_t *m_trie = nullptr;
+  const std::uint8_t *m_state = nullptr;
+};
+
+/**
+ * Read-only view over a top-k index
+ */
+template<typename Node>
+class TopKIndex
+{
+public:
+
+  /**
+   * Empty index
+   */
+  TopKIndex () = default;
+
+  /**
+   * Index serialised in [@p first, @p last) referring to the
+   * trie stored in [@p trie, @p trie_end). Throws
+   * std::runtime_error on inconsistent serialisation.
+   */
+  explicit TopKIndex (const std::uint8_t *first,
+		      const std::uint8_t *last,
+		      const std::uint8_t *trie,
+		      const std::uint8_t *trie_end);
+
+  /**
+   * Precomputed leaves of the subtrie rooted at @p node
+   * (empty if none)
+   */
+  RankedLeaves<Node> find (const Node &node) const;
+
+private:
+
+  static constexpr std::size_t word_size = sizeof (std::uint64_t);
+
+  std::uint64_t word (const std::size_t j) const
+  {
+    return ordered_trie::deserialise<std::uint64_t> (
+      m_first + j * word_size);
+  }
+
+  /*
+   * Validate the node whose offset, rank and children address
+   * are stored from word @p at
+   */
+  void check_node (const std::uint64_t at,
+		   const std::uint64_t trie_size) const;
+
+  /*
+   * Validate the state spanning words [@p first, @p last),
+   * following @p leaves leaves
+   */
+  void check_state (const std::uint64_t first,
+		    const std::uint64_t last,
+		    const std::uint64_t leaves,
+		    const std::uint64_t trie_size) const;
+
+  const std::uint8_t *m_first = nullptr;
+  const std::uint8_t *m_trie = nullptr;
+  std::size_t m_nodes = 0;
+  std::uint64_t m_leaves = 0;
+};
+
+/***********************************************************
+ *
+ * ordered_trie_top_k.hpp - Inlined implementation
+ *
+ ***********************************************************/
+
+template<typename Node>
+Node decode_node (const std::uint8_t  *trie,
+		  const std::uint64_t  offset,
+		  const std::uint64_t  rank,
+		  const std::uint64_t  children)
+{
+  /*
+   * Nodes are decoded relative to the rank and children
+   * address of their previous sibling: recover these by
+   * decoding the node against null bases (see
+   * OrderedLeavesIterator::restore()).
+   */
+  const auto *data = trie + offset;
+  const Node relative {data, 0u, trie};
+  const auto children_offset =
+    static_cast<std::uint64_t> (relative.first_child () - trie);
+
+  return Node {data,
+	       rank - relative.rank (),
+	       trie + (children - children_offset)};
+}
+
+/***********************************************************/
+
+template<typename Node>
+PrecomputedEntry<Node> RankedLeaves<Node>::entry (const std::size_t j) const
+{
+  const auto at = 2 + 3 * links () + size () + 5 * j;
+
+  return PrecomputedEntry<Node>
+  {
+    decode_node<Node> (m_trie,
+		       state_word (at),
+		       state_word (at + 1),
+		       state_word (at + 2)),
+    m_trie + state_word (at + 3),
+    state_word (at + 4)
+  };
+}
+
+/***********************************************************/
+
+template<typename Node>
+TopKIndex<Node>::TopKIndex (const std::uint8_t *first,
+			    const std::uint8_t *last,
+			    const std::uint8_t *trie,
+			    const std::uint8_t *trie_end)
+  : m_first (first)
+  , m_trie (trie)
+{
+  if (first == last)
+  {
+    return;
+  }
+
+  const auto words =
+    static_cast<std::uint64_t> (last - first) / word_size;
+
+  if ((words < 2) || ((last - first) % word_size))
+  {
+    throw std::runtime_error ("Invalid top-k index size");
+  }
+
+  const auto nodes = word (0);
+
+  if ((nodes > (words - 2) / 2) ||
+      (word (1 + 2 * nodes) > (words - 2 - 2 * nodes) / 3))
+  {
+    throw std::runtime_error ("Invalid top-k index size");
+  }
+
+  const auto trie_size = static_cast<std::uint64_t> (trie_end - trie);
+  const auto leaves = word (1 + 2 * nodes);
+  const auto states = 2 + 2 * nodes + 3 * leaves;
+
+  if (words - states < nodes)
+  {
+    throw std::runtime_error ("Invalid top-k index size");
+  }
+
+  std::uint64_t prev_leaf = 0;
+
+  for (std::size_t j = 0; j < nodes; ++j)
+  {
+    const auto first_leaf = word (2 + 2 * j);
+
+    if ((word (1 + 2 * j) >= trie_size) ||
+	(first_leaf < prev_leaf) || (first_leaf > leaves))
+    {
+      throw std::runtime_error ("Invalid top-k index entry");
+    }
+
+    prev_leaf = first_leaf;
+  }
+
+  for (std::size_t j = 0; j < leaves; ++j)
+  {
+    check_node (2 + 2 * nodes + 3 * j, trie_size);
+  }
+
+  for (std::size_t j = 0; j < nodes; ++j)
+  {
+    const auto first = word (states + j);
+    const auto last = (j + 1 < nodes) ? word (states + j + 1) : words;
+    const auto node_leaves = ((j + 1 < nodes) ?
+			      word (2 + 2 * (j + 1)) : leaves) - word (2 + 2 * j);
+
+    if ((first < states + nodes) || (first > last) || (last > words))
+    {
+      throw std::runtime_error ("Invalid top-k index state");
+    }
+
+    check_state (first, last, node_leaves, trie_size);
+  }
+
+  m_nodes = nodes;
+  m_leaves = leaves;
+}
+
+/***********************************************************/
+
+template<typename Node>
+void TopKIndex<Node>::check_node (const std::uint64_t at,
+				  const std::uint64_t trie_size) const
+{
+  const auto offset = word (at);
+
+  if ((offset >= trie_size) || (word (at + 2) > trie_size))
+  {
+    throw std::runtime_error ("Invalid top-k index entry");
+  }
+
+  const Node relative {m_trie + offset, 0u, m_trie};
+
+  if ((word (at + 1) < relative.rank ()) ||
+      (word (at + 2) <
+       static_cast<std::uint64_t> (relative.first_child () - m_trie)))
+  {
+    throw std::runtime_error ("Invalid top-k index entry");
+  }
+}
+
+/***********************************************************/
+
+template<typename Node>
+void TopKIndex<Node>::check_state (const std::uint64_t first,
+				   const std::uint64_t last,
+				   const std::uint64_t leaves,
+				   const std::uint64_t trie_size) const
+{
+  const auto size = last - first;
+
+  const auto fail = []
+  {
+    throw std::runtime_error ("Invalid top-k index state");
+  };
+
+  if (size < 2)
+  {
+    fail ();
+  }
+
+  const auto links = word (first);
+
+  if ((links > (size - 2) / 3) || (leaves > size - 2 - 3 * links))
+  {
+    fail ();
+  }
+
+  for (std::uint64_t l = 0; l < links; ++l)
+  {
+    const auto label = word (first + 1 + 3 * l);
+    const auto label_size = word (first + 2 + 3 * l);
+
+    if ((label > trie_size) || (label_size > trie_size - label) ||
+	(word (first + 3 + 3 * l) > l))
+    {
+      fail ();
+    }
+  }
+
+  const auto paths = first + 1 + 3 * links;
+
+  for (std::uint64_t l = 0; l < leaves; ++l)
+  {
+    if (word (paths + l) > links)
+    {
+      fail ();
+    }
+  }
+
+  const auto entries = word (paths + leaves);
+
+  if (size - 2 - 3 * links - leaves != 5 * entries)
+  {
+    fail ();
+  }
+
+  for (std::uint64_t e = 0; e < entries; ++e)
+  {
+    const auto at = paths + leaves + 1 + 5 * e;
+
+    if ((word (at + 3) > trie_size) || (word (at + 4) > links))
+    {
+      fail ();
+    }
+
+    check_node (at, trie_size);
+  }
+}
+
+/***********************************************************/
+
+template<typename Node>
+RankedLeaves<Node> TopKIndex<Node>::find (const Node &node) const
+{
+  if (m_nodes == 0)
+  {
+    return RankedLeaves<Node> {};
+  }
+
+  const auto offset =
+    static_cast<std::uint64_t> (node.data () - m_trie);
+
+  std::size_t lo = 0;
+  std::size_t hi = m_nodes;
+
+  while (lo < hi)
+  {
+    const auto mid = lo + (hi - lo) / 2;
+
+    if (word (1 + 2 * mid) < offset)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  if ((lo == m_nodes) || (word (1 + 2 * lo) != offset))
+  {
+    return RankedLeaves<Node> {};
+  }
+
+  const auto leaves = m_first + (2 + 2 * m_nodes) * word_size;
+
+  const auto last_leaf = (lo + 1 < m_nodes) ?
+    word (2 + 2 * (lo + 1)) : m_leaves;
+
+  const auto *state =
+    m_first + word (2 + 2 * m_nodes + 3 * m_leaves + lo) * word_size;
+
+  return RankedLeaves<Node>
+  {
+    leaves + word (2 + 2 * lo) * 3 * word_size,
+    leaves + last_leaf * 3 * word_size,
+    m_trie,
+    state
+  };
+}
+
+} // namespace detail {
+} // namespace ordered_trie {
+
+#endif
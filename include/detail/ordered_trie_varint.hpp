@@ -261,6 +261,98 @@ struct OffsetEncoder
   }
 };
 
+/**
+ * Append LEB128 encoding of @p in to @p out, 7 bits per byte
+ * with the highest bit marking continuation.
+ */
+template<typename Bytes>
+void append_varint (Bytes &out, std::uint64_t in)
+{
+  while (in >= 0x80)
+  {
+    out.push_back (static_cast<typename Bytes::value_type> (
+      (in & 0x7F) | 0x80));
+
+    in >>= 7;
+  }
+
+  out.push_back (static_cast<typename Bytes::value_type> (in));
+}
+
+/**
+ * Decode LEB128 integer at @p first, advancing it past the
+ * encoding. Throws std::invalid_argument if the encoding
+ * is truncated at @p last or overflows 64 bits.
+ */
+template<typename InputIt>
+std::uint64_t read_varint (InputIt &first, const InputIt last)
+{
+  std::uint64_t result = 0;
+
+  for (size_t shift = 0; shift < 64; shift += 7)
+  {
+    if (first == last)
+    {
+      throw std::invalid_argument ("Truncated varint");
+    }
+
+    const auto byte = static_cast<std::uint8_t> (*first++);
+    result |= static_cast<std::uint64_t> (byte & 0x7F) << shift;
+
+    if (!(byte & 0x80))
+    {
+      return result;
+    }
+  }
+
+  throw std::invalid_argument ("Varint exceeding 64 bits");
+}
+
+/**
+ * Append to @p out an LEB128 encoding of @p in with bytes in
+ * reverse order, so that it can be decoded backward from the
+ * end of the encoding by read_reversed_varint().
+ */
+inline void append_reversed_varint (std::vector<std::uint8_t> &out,
+				    std::uint64_t              in)
+{
+  std::uint8_t groups[10];
+  size_t size = 0;
+
+  do
+  {
+    groups[size++] = static_cast<std::uint8_t> (in & 0x7F);
+    in >>= 7;
+  }
+  while (in);
+
+  for (size_t j = size; j-- > 0;)
+  {
+    out.push_back (groups[j] | ((j + 1 < size) ? 0x80 : 0));
+  }
+}
+
+/**
+ * Decode integer encoded by append_reversed_varint() ending
+ * right before @p end, moving @p end back to its first byte.
+ */
+inline std::uint64_t read_reversed_varint (const std::uint8_t *&end)
+{
+  std::uint64_t result = 0;
+  size_t shift = 0;
+  std::uint8_t byte;
+
+  do
+  {
+    byte = *(--end);
+    result |= static_cast<std::uint64_t> (byte & 0x7F) << shift;
+    shift += 7;
+  }
+  while (byte & 0x80);
+
+  return result;
+}
+
 }} // namespace ordered_trie { namespace detail {
 
 #endif
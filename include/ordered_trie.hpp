@@ -11,14 +11,31 @@
 #ifndef ORDERED_TRIE_HPP
 #define ORDERED_TRIE_HPP
 
+#include "detail/ordered_trie_batch.hpp"
+#include "detail/ordered_trie_companion.hpp"
+#include "detail/ordered_trie_coroutine.hpp"
+#include "detail/ordered_trie_filter.hpp"
+#include "detail/ordered_trie_fold.hpp"
+#include "detail/ordered_trie_fuzzy.hpp"
+#include "detail/ordered_trie_iterator.hpp"
+#include "detail/ordered_trie_lexicographic.hpp"
 #include "detail/ordered_trie_node.hpp"
+#include "detail/ordered_trie_parallel.hpp"
+#include "detail/ordered_trie_pattern.hpp"
 #include "detail/ordered_trie_store.hpp"
 #include "ordered_trie_serialise.hpp"
 
+#include <boost/optional.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <chrono>
+#include <functional>
 #include <initializer_list>
+#include <limits>
 #include <memory>
 #include <string>
 #include <tuple>
+#include <vector>
 
 namespace ordered_trie {
 
@@ -48,6 +65,83 @@ public:
   operator const pair_t& () const;
 };  
 
+/**
+ * Optional per-subtrie information stored in the trie at
+ * construction time, trading some space for faster queries.
+ */
+struct BuildOptions
+{
+  /**
+   * Store number of suggestions in each subtrie, making
+   * OrderedTrie::count_completions() linear in prefix size.
+   */
+  bool leaf_counts = false;
+
+  /**
+   * Store range of scores in each subtrie, making
+   * OrderedTrie::score_aggregate() linear in prefix size.
+   */
+  bool score_ranges = false;
+
+  /**
+   * Number of best completions precomputed for the subtries
+   * holding more than top_k_threshold suggestions, served by
+   * complete() without visiting the trie (0 to disable).
+   */
+  std::size_t top_k = 0;
+
+  /**
+   * Minimum number of suggestions, exclusive, of the subtries
+   * whose best completions are precomputed. Lower values speed
+   * up more prefixes at the cost of a larger index.
+   */
+  std::size_t top_k_threshold = 1024;
+
+  /**
+   * Bitmasks of the categories of the input suggestions, in
+   * input order, enabling OrderedTrie::complete_filtered()
+   * (empty to disable).
+   */
+  std::vector<std::uint64_t> category_masks;
+
+  /**
+   * Build a secondary index over the suggestions with ASCII
+   * letters folded to lower case, enabling
+   * OrderedTrie::complete_folded().
+   */
+  bool folded_index = false;
+
+  /**
+   * Build a secondary index over the suffixes of the
+   * suggestions starting a word, enabling
+   * OrderedTrie::complete_infix().
+   */
+  bool word_start_index = false;
+
+  /**
+   * Build a secondary index over the reversed suggestions,
+   * enabling OrderedTrie::complete_suffix().
+   */
+  bool suffix_index = false;
+
+  /**
+   * Bits per key of a blocked Bloom filter over the
+   * suggestions, consulted by OrderedTrie::count(), score() and
+   * complete() to reject most missing strings before descending
+   * the trie (0 to disable). Batched and sorted lookups
+   * (count_batch(), score_batch(), count_sorted(),
+   * score_sorted() and complete_batch()) bypass the filter.
+   */
+  std::size_t filter_bits_per_key = 0;
+
+  /**
+   * Also store in the filter the prefixes of the suggestions up
+   * to this length, so that complete() rejects most prefixes
+   * of no suggestion (0 to disable).
+   */
+  std::size_t filter_prefix_length = 0;
+};
+
 /**
  * OrderedTrie
  */
@@ -64,6 +158,74 @@ public:
    */
   class iterator;
 
+  /**
+   * Reusable state for completion queries. Passing the same
+   * context to successive calls of complete() avoids any heap
+   * allocation once its buffers have grown to the required size.
+   * A context serves a single query at a time and must not be
+   * shared across threads.
+   */
+  class QueryContext;
+
+  /**
+   * Single-pass completions iterator whose state is hosted
+   * by a QueryContext.
+   */
+  class context_iterator;
+
+  /**
+   * Lightweight reference to a completion hosted by a
+   * QueryContext, spelling the string and decoding the
+   * score only on request.
+   */
+  class CompletionRef;
+
+  /**
+   * Single-pass iterator over CompletionRef objects.
+   */
+  class ref_iterator;
+
+  /**
+   * Iterator over suggestions in lexicographic order.
+   */
+  class lexicographic_iterator;
+
+  /**
+   * Iterator over completions found through a secondary
+   * index (see BuildOptions).
+   */
+  class companion_iterator;
+
+  /**
+   * Prefix typed one byte at a time, matched incrementally
+   * against the trie.
+   */
+  class CompletionSession;
+
+  /**
+   * Position of a manual descent along a prefix, probing
+   * its continuations without restarting from the root.
+   */
+  class PrefixCursor;
+
+  /**
+   * Bounds of a completion query. Completions whose score is
+   * ranked after min_score by the comparer the trie was built
+   * or read with are not enumerated. The enumeration is
+   * truncated once max_expansions trie nodes have been
+   * expanded, or past the deadline.
+   */
+  struct CompleteOptions
+  {
+    boost::optional<Score> min_score;
+
+    std::size_t max_expansions =
+      std::numeric_limits<std::size_t>::max ();
+
+    std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::time_point::max ();
+  };
+
   /**
    * Default empty trie
    */
@@ -89,6 +251,16 @@ public:
 			FwdIt last,
 			const Comparer &score_comparer);
 
+  /**
+   * Range based ctor with custom score comparison functor
+   * storing the optional information selected by @p options.
+   */
+  template<typename FwdIt, typename Comparer>
+  explicit OrderedTrie (FwdIt               first,
+			FwdIt               last,
+			const Comparer     &score_comparer,
+			const BuildOptions &options);
+
   /**
    * Ctor from initializer list
    */
@@ -132,6 +304,270 @@ public:
   auto complete (FwdIt first, FwdIt last) const
     -> boost::iterator_range<iterator>;  
 
+  /**
+   * @overload of complete() running the query inside the given
+   * @p context. The returned range is single-pass and remains
+   * valid until @p context is used for another query.
+   */
+  auto complete (const std::string &prefix,
+		 QueryContext      &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * @overload complete() with context taking input prefix
+   * in range form.
+   */
+  template<typename FwdIt>
+  auto complete (FwdIt         first,
+		 FwdIt         last,
+		 QueryContext &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * @overload of complete() bounding the enumeration by
+   * @p options. Whether the enumeration was truncated by the
+   * expansions budget or the deadline is reported by
+   * iterator::truncated() once the end is reached.
+   */
+  auto complete (const std::string     &prefix,
+		 const CompleteOptions &options) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload complete() bounded by @p options taking input
+   * prefix in range form.
+   */
+  template<typename FwdIt>
+  auto complete (FwdIt                  first,
+		 FwdIt                  last,
+		 const CompleteOptions &options) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload of complete() with context bounding the
+   * enumeration by @p options. Truncation is reported by
+   * QueryContext::truncated().
+   */
+  auto complete (const std::string     &prefix,
+		 const CompleteOptions &options,
+		 QueryContext          &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * @overload complete() with context bounded by @p options
+   * taking input prefix in range form.
+   */
+  template<typename FwdIt>
+  auto complete (FwdIt                  first,
+		 FwdIt                  last,
+		 const CompleteOptions &options,
+		 QueryContext          &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * Returns range of the completions of @p prefix whose
+   * category mask intersects @p categories, ordered by
+   * decreasing score, skipping the subtries holding none of
+   * them. Throws std::logic_error if the trie was not built
+   * with BuildOptions::category_masks.
+   */
+  auto complete_filtered (const std::string   &prefix,
+			  const std::uint64_t  categories) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload of complete_filtered() with context.
+   */
+  auto complete_filtered (const std::string   &prefix,
+			  const std::uint64_t  categories,
+			  QueryContext        &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * Returns range of the completions of any of the strings in
+   * @p prefixes, ordered by decreasing score. Completions of
+   * several prefixes (when one is a prefix of another) are
+   * enumerated once.
+   */
+  template<typename FwdRange>
+  auto complete_any (const FwdRange &prefixes) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload of complete_any() taking prefixes in
+   * initializer list form.
+   */
+  auto complete_any (
+    std::initializer_list<boost::string_ref> prefixes) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload of complete_any() running the query inside the
+   * given @p context.
+   */
+  template<typename FwdRange>
+  auto complete_any (const FwdRange &prefixes,
+		     QueryContext   &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * Returns range of the completions of @p prefix ignoring the
+   * case of ASCII letters, ordered by decreasing score. Throws
+   * std::logic_error if the trie was not built with
+   * BuildOptions::folded_index.
+   */
+  auto complete_folded (const std::string &prefix) const
+    -> boost::iterator_range<companion_iterator>;
+
+  /**
+   * Returns range of the suggestions having a word starting
+   * with @p prefix, ignoring the case of ASCII letters, ordered
+   * by decreasing score. Words are separated by ASCII
+   * whitespace and punctuation, and each suggestion is
+   * returned once. Throws std::logic_error if the
+   * trie was not built with BuildOptions::word_start_index.
+   */
+  auto complete_infix (const std::string &prefix) const
+    -> boost::iterator_range<companion_iterator>;
+
+  /**
+   * Returns range of the suggestions ending with @p suffix,
+   * ordered by decreasing score. Throws std::logic_error if the
+   * trie was not built with BuildOptions::suffix_index.
+   */
+  auto complete_suffix (const std::string &suffix) const
+    -> boost::iterator_range<companion_iterator>;
+
+  /**
+   * Returns range of the completions of the strings within
+   * @p max_edits Levenshtein edits (insertions, deletions or
+   * substitutions of a byte) from @p prefix, ordered by
+   * decreasing score.
+   */
+  auto complete_fuzzy (const std::string &prefix,
+		       const std::size_t  max_edits) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload of complete_fuzzy() running the query inside
+   * the given @p context.
+   */
+  auto complete_fuzzy (const std::string &prefix,
+		       const std::size_t  max_edits,
+		       QueryContext      &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * Returns range of the suggestions matching the glob
+   * @p pattern, ordered by decreasing score. Patterns are made
+   * up of '?' (any byte), '*' (any string), classes like
+   * '[a-c]' or '[!a-c]', escapes like '\\*' and bytes matching
+   * themselves, e.g. "b?r*" or "[a-c]ar". Throws
+   * std::invalid_argument on malformed patterns.
+   */
+  auto complete_pattern (const std::string &pattern) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload of complete_pattern() running the query inside
+   * the given @p context.
+   */
+  auto complete_pattern (const std::string &pattern,
+			 QueryContext      &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * Same as complete() with context, but the returned range
+   * enumerates CompletionRef objects. These remain valid until
+   * @p context is used for another query.
+   */
+  auto complete_refs (const std::string &prefix,
+		      QueryContext      &context) const
+    -> boost::iterator_range<ref_iterator>;
+
+  /**
+   * @overload of complete_refs() taking input prefix in
+   * range form.
+   */
+  template<typename FwdIt>
+  auto complete_refs (FwdIt         first,
+		      FwdIt         last,
+		      QueryContext &context) const
+    -> boost::iterator_range<ref_iterator>;
+
+  /**
+   * Returns range of all suggestions ordered by increasing
+   * lexicographic order of their string.
+   */
+  auto lexicographic () const
+    -> boost::iterator_range<lexicographic_iterator>;
+
+  /**
+   * Returns iterator to the first suggestion, in lexicographic
+   * order, not lower than @p key. Together with upper_bound()
+   * this delimits the suggestions in a range of strings, e.g.
+   * make_iterator_range (lower_bound ("foo"), lower_bound ("fop")).
+   */
+  auto lower_bound (const std::string &key) const
+    -> lexicographic_iterator;
+
+  /**
+   * Returns iterator to the first suggestion, in lexicographic
+   * order, greater than @p key.
+   */
+  auto upper_bound (const std::string &key) const
+    -> lexicographic_iterator;
+
+  /**
+   * Resume an enumeration of completions from a cursor obtained
+   * from iterator::cursor() over this same trie. The returned
+   * range starts at the element the iterator was pointing to.
+   * Throws std::invalid_argument on malformed cursor.
+   */
+  auto resume (const std::string &cursor) const
+    -> boost::iterator_range<iterator>;
+
+  /**
+   * @overload of resume() running the enumeration inside
+   * given @p context.
+   */
+  auto resume (const std::string &cursor,
+	       QueryContext      &context) const
+    -> boost::iterator_range<context_iterator>;
+
+  /**
+   * Returns number of completions of given @p prefix. This
+   * takes time linear in prefix size if the trie was built
+   * with BuildOptions::leaf_counts, and linear in the number
+   * of completions otherwise.
+   */
+  size_t count_completions (const std::string &prefix) const;
+
+  /**
+   * @overload of count_completions() taking input prefix
+   * in range form.
+   */
+  template<typename FwdIt>
+  size_t count_completions (FwdIt first, FwdIt last) const;
+
+  /**
+   * Returns the pair of best and worst scores among the
+   * completions of given @p prefix, or none if there are no
+   * completions. This takes time linear in prefix size if the
+   * trie was built with BuildOptions::score_ranges, and linear
+   * in the number of completions otherwise.
+   */
+  auto score_aggregate (const std::string &prefix) const
+    -> boost::optional<std::pair<Score, Score>>;
+
+  /**
+   * @overload of score_aggregate() taking input prefix
+   * in range form.
+   */
+  template<typename FwdIt>
+  auto score_aggregate (FwdIt first, FwdIt last) const
+    -> boost::optional<std::pair<Score, Score>>;
+
   /**
    * Match input string against trie content returning
    * length of the longest prefix of input string which
@@ -146,6 +582,13 @@ public:
   template<typename FwdIt>
   FwdIt mismatch (FwdIt begin, FwdIt end) const;
 
+  /**
+   * Returns a cursor on the longest prefix of @p input which
+   * is also prefix of a suggestion (see mismatch()).
+   */
+  auto prefix_cursor (const std::string &input = std::string {}) const
+    -> PrefixCursor;
+
   /**
    * Search a trie suggestion equal to @p input string.
    * If present, returns true and store the associated
@@ -187,6 +630,136 @@ public:
    */
   template<typename FwdIt>
   size_t count (FwdIt first, FwdIt last) const;
+
+  /**
+   * Batched count() of the strings of @p inputs, returned in
+   * the same order. The descents along the strings advance
+   * interleaved, so that their cache misses overlap.
+   */
+  template<typename FwdRange>
+  std::vector<size_t> count_batch (const FwdRange &inputs) const;
+
+  /**
+   * Batched score() of the strings of @p inputs, returned in
+   * the same order (none for the missing ones). See
+   * count_batch().
+   */
+  template<typename FwdRange>
+  std::vector<boost::optional<Score>> score_batch (
+    const FwdRange &inputs) const;
+
+  /**
+   * Returns the first @p k completions, by decreasing score, of
+   * each prefix of @p prefixes, in the same order. The prefixes
+   * are matched as in count_batch().
+   */
+  template<typename FwdRange>
+  std::vector<std::vector<value_type>> complete_batch (
+    const FwdRange    &prefixes,
+    const std::size_t  k) const;
+
+  /**
+   * Write to @p output the count() of each string of
+   * @p inputs, returning the end of the output. Each lookup
+   * resumes from the path of the previous one, backtracking
+   * only to their longest common prefix: on sorted inputs,
+   * the nodes shared by their paths are visited once.
+   */
+  template<typename FwdRange, typename OutputIt>
+  OutputIt count_sorted (const FwdRange &inputs,
+			 OutputIt        output) const;
+
+  /**
+   * Write to @p output the score of each string of @p inputs
+   * as a boost::optional<Score> (none if missing), returning
+   * the end of the output. See count_sorted().
+   */
+  template<typename FwdRange, typename OutputIt>
+  OutputIt score_sorted (const FwdRange &inputs,
+			 OutputIt        output) const;
+
+  /**
+   * Find the first @p k completions of each prefix of the
+   * random access range @p prefixes on @p threads threads (0
+   * for one per hardware thread), the calling one included.
+   * Chunks of prefixes are handed out by a work stealing pool
+   * and batched as in complete_batch().
+   *
+   * The completions of the j-th prefix are passed, in no
+   * particular order of j, to @p sink (worker, j, completions),
+   * where worker in [0, threads) identifies the calling thread
+   * and completions is a range of value_type valid only during
+   * the call. The sink is called concurrently by different
+   * workers: it must be thread-safe, or partition its state by
+   * worker. The first exception it throws stops the workers and
+   * is rethrown.
+   */
+  template<typename RandomAccessRange, typename Sink>
+  void parallel_complete (const RandomAccessRange &prefixes,
+			  const std::size_t        k,
+			  Sink                   &&sink,
+			  const std::size_t        threads = 0) const;
+
+  /**
+   * Order of the suggestions returned by parallel_export()
+   */
+  enum ExportOrder
+  {
+    EXPORT_LEXICOGRAPHIC,   ///< Increasing lexicographic order
+    EXPORT_PARTITION_RANK,  ///< Increasing rank within each partition
+    EXPORT_RANK             ///< Increasing rank, as begin()
+  };
+
+  /**
+   * Returns all the suggestions, split into the disjoint
+   * subtries of the nodes @p depth levels below the root (and
+   * the leaves above them), each enumerated on one of
+   * @p threads threads (0 for one per hardware thread).
+   *
+   * Partitions are listed by lexicographic order of their
+   * strings. With EXPORT_LEXICOGRAPHIC their concatenation is
+   * sorted, with EXPORT_PARTITION_RANK each of them is sorted by
+   * rank, while EXPORT_RANK merges them into a single one
+   * sorted by rank.
+   */
+  auto parallel_export (const ExportOrder order = EXPORT_LEXICOGRAPHIC,
+			const std::size_t threads = 0,
+			const std::size_t depth = 2) const
+    -> std::vector<std::vector<value_type>>;
+
+#if ORDERED_TRIE_HAS_COROUTINES
+  /**
+   * Query of a mixed batch: the score of a suggestion or its
+   * first k completions
+   */
+  struct Lookup
+  {
+    enum Kind { SCORE, COMPLETE };
+
+    Kind kind = SCORE;
+    std::string input;
+    std::size_t k = 0;
+  };
+
+  /**
+   * Result of a Lookup: the score (none if missing) or the
+   * completions, depending on its kind
+   */
+  struct LookupResult
+  {
+    boost::optional<Score> score;
+    std::vector<value_type> completions;
+  };
+
+  /**
+   * Run @p lookups returning their results in the same order.
+   * Each lookup is a coroutine suspending before it scans the
+   * children of a node, whose cache lines are then loaded while
+   * the other lookups run. Available when compiling for C++20.
+   */
+  std::vector<LookupResult> lookup_interleaved (
+    const std::vector<Lookup> &lookups) const;
+#endif
   
   /**
    * Write serialised trie to file.
@@ -195,19 +768,118 @@ public:
 
   /**
    * Read instance from file where it was previously
-   * stored using write().
+   * stored using write(). Bounding its completions by score
+   * (see CompleteOptions) throws std::logic_error unless it
+   * was built with the default score comparer.
    */
   static OrderedTrie read (const std::string &path);
 
+  /**
+   * @overload of read() for a trie built with
+   * @p score_comparer. Throws std::invalid_argument if the
+   * stored scores are not ordered by @p score_comparer.
+   */
+  template<typename Comparer>
+  static OrderedTrie read (const std::string &path,
+			   const Comparer    &score_comparer);
+
 private:
   class Parameters;
   using Node = detail::Node<Void>;
   using Store = detail::Store<Parameters>;
 
-  explicit OrderedTrie (std::shared_ptr<const Store>);  
+  /*
+   * Rank of the last score of the score table not ranked
+   * after a given one by the comparer of the trie, if any
+   */
+  using RankBound = std::function<
+    boost::optional<std::uint64_t> (const std::uint8_t*,
+				    const std::uint8_t*,
+				    const Score&)>;
+
+  template<typename Comparer>
+  explicit OrderedTrie (std::shared_ptr<const Store>,
+			const Comparer &score_comparer);
+
+  template<typename Comparer>
+  static RankBound make_rank_bound (const Comparer &score_comparer);
+
+  template<typename FwdIt>
+  void start_visit (
+    detail::OrderedLeavesIterator<Node> &visitor,
+    FwdIt                                first,
+    FwdIt                                last,
+    const detail::VisitLimits           &limits = {},
+    const boost::optional<std::uint64_t> &categories = boost::none) const;
+
+  template<typename FwdRange>
+  void start_visit_any (
+    detail::OrderedLeavesIterator<Node> &visitor,
+    const FwdRange                      &prefixes) const;
+
+  template<typename FwdIt>
+  void start_companion_visit (
+    detail::CompanionLeavesIterator<Node> &visitor,
+    const std::uint64_t                    kind,
+    FwdIt                                  first,
+    FwdIt                                  last,
+    const bool                             word_starts) const;
+
+  void seed_loci (
+    detail::OrderedLeavesIterator<Node>        &visitor,
+    std::vector<std::pair<Node, std::size_t>>   loci) const;
+
+  template<typename FwdIt>
+  auto match_locus (
+    detail::OrderedLeavesIterator<Node> &visitor,
+    FwdIt                                first,
+    FwdIt                                last,
+    const std::uint8_t                 **subtree_end = nullptr) const
+    -> boost::optional<std::pair<Node, std::size_t>>;
+
+  auto make_limits (const CompleteOptions &options) const
+    -> boost::optional<detail::VisitLimits>;
+
+  void make_completion (
+    const detail::OrderedLeavesIterator<Node> &visitor,
+    value_type                                &output) const;
+
+  void seed_path (
+    detail::OrderedLeavesIterator<Node> &visitor,
+    const std::vector<Node>             &nodes) const;
+
+  static auto follow_byte (const Node         &locus,
+			   const std::size_t   offset,
+			   const std::uint8_t  byte)
+    -> boost::optional<Node>;
+
+  std::size_t collect_completions (
+    detail::OrderedLeavesIterator<Node> &visitor,
+    const Node                          &locus,
+    const std::string                   &head,
+    const std::size_t                    k,
+    std::vector<value_type>             &output) const;
+
+  std::string save_cursor (
+    const detail::OrderedLeavesIterator<Node> &visitor) const;
+
+  void restore_cursor (
+    detail::OrderedLeavesIterator<Node> &visitor,
+    const std::string                   &cursor) const;
+
+  template<typename FwdIt>
+  auto summarise (FwdIt               first,
+		  FwdIt               last,
+		  const std::uint64_t required) const
+    -> boost::optional<detail::SubtreeSummary>;
+
   Node m_root;
   const std::uint8_t *m_score_table;
+  detail::TopKIndex<Node> m_top_k;
+  detail::CompanionDirectory m_companions;
+  detail::BloomFilter m_filter;
   std::shared_ptr<const Store> m_store;
+  RankBound m_rank_bound;
 };
 
 /**
@@ -228,6 +900,15 @@ template<typename FwdRange, typename Comparer>
 auto make_ordered_trie (const FwdRange &suggestions,
 			const Comparer &score_comparer);
 
+/**
+ * @overload of make_ordered_trie() storing the optional
+ * information selected by @p options.
+ */
+template<typename FwdRange, typename Comparer>
+auto make_ordered_trie (const FwdRange     &suggestions,
+			const Comparer     &score_comparer,
+			const BuildOptions &options);
+
 } // namespace ordered_trie {
 
 #include "detail/ordered_trie_impl.hpp"
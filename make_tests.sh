@@ -9,3 +9,7 @@ echo
 echo "Running tests..."
 
 ./build/bin/test_ordered_trie
+
+if [ -x ./build/bin/test_ordered_trie_coroutine ]; then
+    ./build/bin/test_ordered_trie_coroutine
+fi
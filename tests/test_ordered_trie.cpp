@@ -17,11 +17,20 @@
 #include <boost/range.hpp>
 #include <boost/optional.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <fstream>
 #include <iterator>
+#include <limits>
+#include <list>
+#include <map>
+#include <numeric>
+#include <regex>
 #include <random>
 #include <tuple>
 #include <bitset>
+#include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <functional>
 #include <utility>
@@ -31,6 +40,46 @@ BOOST_AUTO_TEST_CASE (dummy) {}
 using namespace ordered_trie;
 using namespace ordered_trie::test_utils;
 
+namespace ordered_trie {
+
+/*
+ * Arithmetic scores serialised by the user, as varints
+ */
+template<> struct Serialise<long long>
+{
+  static std::string format_id ()
+  {
+    return "VARINT_LONG_LONG";
+  }
+
+  static void serialise (std::vector<std::uint8_t> &out,
+			 const long long value)
+  {
+    detail::append_varint (out, static_cast<std::uint64_t> (value));
+  }
+
+  static long long deserialise (const std::uint8_t *in)
+  {
+    return static_cast<long long> (
+      detail::read_varint (in, in + max_size));
+  }
+
+  static const std::uint8_t* skip (const std::uint8_t *in)
+  {
+    detail::read_varint (in, in + max_size);
+    return in;
+  }
+
+  constexpr static size_t estimated_max_size ()
+  {
+    return max_size;
+  }
+
+  static constexpr size_t max_size = 10;
+};
+
+} // namespace ordered_trie {
+
 namespace
 {
 
@@ -287,6 +336,132 @@ BOOST_AUTO_TEST_CASE (test_node_serialise_leaf)
   BOOST_CHECK_EQUAL (node.rank (), 10u);
 }
 
+BOOST_AUTO_TEST_CASE (test_radix_heap_frontier)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (12, 4000, 11);
+
+  const auto trie =
+    detail::make_serialised_ordered_trie (suggestions);
+
+  const auto root = make_root (trie.data ());
+
+  using Node = detail::Node<Void>;
+  using BinaryHeapVisit = detail::OrderedLeavesIterator<Node>;
+  using RadixHeapVisit = detail::OrderedLeavesIterator<
+    Node, detail::RadixHeapFrontier>;
+
+  BinaryHeapVisit expected_visit {detail::visit_children (root)};
+  RadixHeapVisit visit {detail::visit_children (root)};
+
+  std::vector<std::pair<std::uint64_t, std::string>> expected;
+  std::vector<std::pair<std::uint64_t, std::string>> result;
+
+  for (; expected_visit; ++expected_visit)
+  {
+    expected.emplace_back (expected_visit->rank (), std::string {});
+    expected_visit.write_string (
+      expected_visit.path (), *expected_visit, expected.back ().second);
+  }
+
+  for (; visit; ++visit)
+  {
+    BOOST_CHECK (result.empty () ||
+		 result.back ().first <= visit->rank ());
+
+    result.emplace_back (visit->rank (), std::string {});
+    visit.write_string (visit.path (), *visit, result.back ().second);
+  }
+
+  BOOST_CHECK_EQUAL (result.size (), suggestions.size ());
+  std::sort (expected.begin (), expected.end ());
+  std::sort (result.begin (), result.end ());
+  BOOST_CHECK (result == expected);
+}
+
+BOOST_AUTO_TEST_CASE (test_top_k_index_states)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 47);
+
+  const auto trie =
+    detail::make_serialised_ordered_trie (suggestions);
+
+  const auto root = make_root (trie.data ());
+
+  using Node = detail::Node<Void>;
+  using Visit = detail::OrderedLeavesIterator<Node>;
+
+  const auto *trie_end = trie.data () + trie.size ();
+  const auto index =
+    detail::make_top_k_index<Visit> (root, trie.data (), 5, 20);
+
+  const auto nodes =
+    ordered_trie::deserialise<std::uint64_t> (index.data ());
+
+  BOOST_REQUIRE (nodes > 0);
+
+  const detail::TopKIndex<Node> top_k {
+    index.data (), index.data () + index.size (), trie.data (), trie_end};
+
+  BOOST_CHECK_THROW (
+    (detail::TopKIndex<Node> {index.data (),
+			      index.data () + index.size () - 8,
+			      trie.data (), trie_end}),
+    std::runtime_error);
+
+  const auto collect = [] (Visit &visit)
+  {
+    std::vector<std::pair<std::uint64_t, std::string>> result;
+
+    for (; visit; ++visit)
+    {
+      result.emplace_back (visit->rank (), std::string {});
+      visit.write_string (visit.path (), *visit, result.back ().second);
+    }
+
+    return result;
+  };
+
+  std::vector<Node> stack {root};
+  std::size_t heavy = 0;
+
+  while (!stack.empty ())
+  {
+    const auto node = stack.back ();
+    stack.pop_back ();
+
+    for (auto it = detail::visit_children (node); it; ++it)
+    {
+      if (!it->is_leaf ())
+      {
+	stack.push_back (*it);
+      }
+    }
+
+    const auto leaves = top_k.find (node);
+
+    if (leaves.empty ())
+    {
+      continue;
+    }
+
+    ++heavy;
+
+    const detail::SiblingsIterator<Node> range {
+      node, Node::skip (node.data ())};
+
+    Visit plain {range};
+    const auto expected = collect (plain);
+
+    Visit visit;
+    visit.seed (range, Visit::no_link, leaves);
+    BOOST_CHECK (collect (visit) == expected);
+  }
+
+  BOOST_CHECK_EQUAL (heavy, nodes);
+}
+
 BOOST_AUTO_TEST_CASE (test_ordered_trie_empty)
 {
   TemporaryFile tmp_file;
@@ -312,6 +487,36 @@ BOOST_AUTO_TEST_CASE (test_ordered_trie_empty)
   }
 }
 
+BOOST_AUTO_TEST_CASE (test_ordered_trie_high_bytes)
+{
+  using Suggestion =
+    typename OrderedTrie<std::uint64_t>::value_type;
+
+  /*
+   * Bytes above 0x7f, as found in UTF-8 text
+   */
+  const OrderedTrie<std::uint64_t> trie
+  {
+    {"cafe", 2u},
+    {"caf\xc3\xa9", 3u},
+    {"caf\xc3\xa9s", 1u},
+    {"\xff", 4u}
+  };
+
+  const std::vector<Suggestion> expected
+  {
+    {"caf\xc3\xa9", 3u},
+    {"caf\xc3\xa9s", 1u}
+  };
+
+  BOOST_CHECK (trie.count ("caf\xc3\xa9"));
+  BOOST_CHECK (!trie.count ("caf\xc3"));
+  BOOST_CHECK_EQUAL (trie.score ("caf\xc3\xa9s"), 1u);
+  BOOST_CHECK_EQUAL (trie.score ("\xff"), 4u);
+  BOOST_CHECK (make_vector (trie.complete ("caf\xc3")) == expected);
+  BOOST_CHECK_EQUAL (make_vector (trie.complete ("\xff")).size (), 1u);
+}
+
 BOOST_AUTO_TEST_CASE (test_ordered_trie_2)
 {
   using Suggestion =
@@ -598,6 +803,1817 @@ BOOST_AUTO_TEST_CASE (test_ordered_trie_random_data)
   } ());  
 }
 
+BOOST_AUTO_TEST_CASE (test_ordered_trie_query_context)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 17);
+
+  const auto trie = make_ordered_trie (suggestions);
+  OrderedTrie<std::uint64_t>::QueryContext context;
+
+  for (const auto &prefix :
+	 {"", "0", "1", "01", "110", "1111", "2", "0101010"})
+  {
+    const auto expected = make_vector (trie.complete (prefix));
+    std::vector<Completion<std::uint64_t>> result;
+
+    for (const auto &c : trie.complete (prefix, context))
+    {
+      result.push_back (c);
+    }
+
+    BOOST_CHECK (result == expected);
+  }
+
+  BOOST_CHECK (trie.complete ("2", context).empty ());
+  BOOST_CHECK (
+    OrderedTrie<std::uint64_t> {}.complete ("", context).empty ());
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_completion_refs)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 5);
+
+  const auto trie = make_ordered_trie (suggestions);
+  OrderedTrie<std::uint64_t>::QueryContext context;
+
+  for (const auto &prefix : {"", "0", "10", "1101", "2"})
+  {
+    const auto expected = make_vector (trie.complete (prefix));
+    std::vector<Completion<std::uint64_t>> result;
+    std::string buffer;
+
+    for (const auto &ref : trie.complete_refs (prefix, context))
+    {
+      buffer.clear ();
+      ref.write_string (buffer);
+      BOOST_CHECK (ref.string_view () == buffer);
+      result.push_back ({buffer, ref.score ()});
+    }
+
+    BOOST_CHECK (result == expected);
+
+    /*
+     * References remain valid past the leaf they were taken at
+     */
+    const auto refs = make_vector (trie.complete_refs (prefix, context));
+    result.clear ();
+
+    for (const auto &ref : refs)
+    {
+      buffer.clear ();
+      ref.write_string (buffer);
+      result.push_back ({buffer, ref.score ()});
+    }
+
+    BOOST_CHECK (result == expected);
+  }
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_cursor)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 23);
+
+  const auto trie = make_ordered_trie (suggestions);
+  OrderedTrie<std::uint64_t>::QueryContext context;
+
+  for (const auto &prefix : {"", "0", "10", "1101", "2"})
+  {
+    const auto expected = make_vector (trie.complete (prefix));
+
+    for (const size_t page_size : {1u, 3u, 50u})
+    {
+      std::vector<Completion<std::uint64_t>> result;
+      auto page = trie.complete (prefix);
+
+      while (!page.empty ())
+      {
+	auto it = page.begin ();
+
+	for (size_t j = 0; (j < page_size) && (it != page.end ()); ++j)
+	{
+	  result.push_back (*it++);
+	}
+
+	page = trie.resume (it.cursor ());
+      }
+
+      BOOST_CHECK (result == expected);
+    }
+
+    /*
+     * Resume in context from the middle of the enumeration
+     */
+    auto it = trie.complete (prefix, context).begin ();
+    std::vector<Completion<std::uint64_t>> result;
+
+    for (size_t j = 0; (j < 5) && (j < expected.size ()); ++j)
+    {
+      result.push_back (*it++);
+    }
+
+    const auto cursor = it.cursor ();
+
+    for (const auto &c : trie.resume (cursor, context))
+    {
+      result.push_back (c);
+    }
+
+    BOOST_CHECK (result == expected);
+  }
+
+  BOOST_CHECK_THROW (trie.resume ("garbage"), std::invalid_argument);
+
+  const OrderedTrie<std::uint64_t> other_trie {{"x", 1u}};
+  const auto other_cursor = trie.begin ().cursor ();
+
+  BOOST_CHECK_THROW (other_trie.resume (other_cursor),
+		     std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_corrupted_cursor)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 23);
+
+  const std::map<std::string, std::uint64_t> scores (
+    suggestions.begin (), suggestions.end ());
+
+  BuildOptions options;
+  options.category_masks.assign (suggestions.size (), 1u);
+  options.category_masks[0] = 2u;
+
+  const auto trie = make_ordered_trie (
+    suggestions, std::greater<> {}, options);
+
+  std::vector<std::string> cursors;
+
+  for (const auto &prefix : {"", "0", "10"})
+  {
+    auto it = trie.complete (prefix).begin ();
+    auto filtered = trie.complete_filtered (prefix, 1u).begin ();
+
+    for (size_t j = 0; j < 3; ++j)
+    {
+      ++it;
+      ++filtered;
+    }
+
+    cursors.push_back (it.cursor ());
+    cursors.push_back (filtered.cursor ());
+  }
+
+  /*
+   * Resuming must either throw std::invalid_argument or
+   * enumerate suggestions of the trie
+   */
+  const auto resume = [&] (const std::string &cursor)
+  {
+    try
+    {
+      for (const auto &c : trie.resume (cursor))
+      {
+	const auto found = scores.find (c.first);
+	BOOST_REQUIRE (found != scores.end ());
+	BOOST_CHECK_EQUAL (found->second, c.second);
+      }
+    }
+    catch (const std::invalid_argument&)
+    {
+      return false;
+    }
+
+    return true;
+  };
+
+  std::size_t rejected = 0;
+
+  for (const auto &cursor : cursors)
+  {
+    BOOST_CHECK (resume (cursor));
+
+    for (size_t size = 0; size < cursor.size (); ++size)
+    {
+      BOOST_CHECK (!resume (cursor.substr (0, size)));
+    }
+
+    for (size_t j = 0; j < cursor.size (); ++j)
+    {
+      for (const unsigned char flip : {0x01u, 0x02u, 0x40u, 0x7fu, 0x80u})
+      {
+	auto corrupted = cursor;
+	corrupted[j] = static_cast<char> (corrupted[j] ^ flip);
+	rejected += !resume (corrupted);
+      }
+    }
+  }
+
+  BOOST_CHECK (rejected > 0);
+
+  /*
+   * Counts of links and entries are not trusted for
+   * allocating storage
+   */
+  const auto header = [&]
+  {
+    const auto cursor = trie.begin ().cursor ();
+    auto first = cursor.begin ();
+
+    detail::read_varint (first, cursor.end ());
+    detail::read_varint (first, cursor.end ());
+
+    std::string result (cursor.begin (), first);
+    detail::append_varint (result, 0u);
+
+    return result;
+  } ();
+
+  for (const auto links : {std::uint64_t {1} << 60, std::uint64_t {0}})
+  {
+    auto cursor = header;
+    detail::append_varint (cursor, links);
+
+    if (!links)
+    {
+      detail::append_varint (cursor, std::uint64_t {1} << 60);
+    }
+
+    BOOST_CHECK (!resume (cursor));
+  }
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_subtree_summary)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 31);
+
+  std::unordered_set<std::string> prefixes {"", "2", "0002"};
+
+  for (const auto &s : suggestions)
+  {
+    for (size_t j = 0; j <= s.first.size (); ++j)
+    {
+      prefixes.insert (s.first.substr (0, j));
+    }
+  }
+
+  const auto check = [&] (const OrderedTrie<std::uint64_t> &trie)
+  {
+    for (const auto &prefix : prefixes)
+    {
+      const auto expected =
+	complete (suggestions, prefix, std::greater<> {});
+
+      BOOST_CHECK_EQUAL (trie.count_completions (prefix),
+			 expected.size ());
+
+      BOOST_CHECK_EQUAL (make_vector (trie.complete (prefix)).size (),
+			 expected.size ());
+
+      const auto aggregate = trie.score_aggregate (prefix);
+      BOOST_CHECK_EQUAL (!!aggregate, !expected.empty ());
+
+      if (aggregate && !expected.empty ())
+      {
+	const auto scores = std::minmax_element (
+	  expected.begin (), expected.end (),
+	  [] (const auto &x, const auto &y)
+	  {
+	    return x.second < y.second;
+	  });
+
+	BOOST_CHECK_EQUAL (aggregate->first, scores.second->second);
+	BOOST_CHECK_EQUAL (aggregate->second, scores.first->second);
+      }
+    }
+  };
+
+  for (const auto leaf_counts : {false, true})
+  {
+    for (const auto score_ranges : {false, true})
+    {
+      BuildOptions options;
+      options.leaf_counts = leaf_counts;
+      options.score_ranges = score_ranges;
+
+      const auto trie = make_ordered_trie (
+	suggestions, std::greater<> {}, options);
+
+      check (trie);
+      BOOST_CHECK (make_vector (trie) ==
+		   make_vector (make_ordered_trie (suggestions)));
+
+      TemporaryFile tmp_file;
+      trie.write (tmp_file.get ());
+      check (OrderedTrie<std::uint64_t>::read (tmp_file.get ()));
+    }
+  }
+
+  const OrderedTrie<std::uint64_t> empty_trie;
+  BOOST_CHECK_EQUAL (empty_trie.count_completions (""), 0u);
+  BOOST_CHECK (!empty_trie.score_aggregate (""));
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_top_k)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 47);
+
+  const auto reference = make_ordered_trie (suggestions);
+
+  BuildOptions options;
+  options.top_k = 5;
+  options.top_k_threshold = 20;
+
+  const auto trie = make_ordered_trie (
+    suggestions, std::greater<> {}, options);
+
+  std::unordered_set<std::string> prefixes;
+
+  for (const auto &s : suggestions)
+  {
+    for (size_t j = 0; j <= s.first.size (); ++j)
+    {
+      prefixes.insert (s.first.substr (0, j));
+    }
+  }
+
+  const auto check = [&] (const OrderedTrie<std::uint64_t> &t)
+  {
+    OrderedTrie<std::uint64_t>::QueryContext context;
+
+    for (const auto &prefix : prefixes)
+    {
+      const auto expected = make_vector (reference.complete (prefix));
+      BOOST_CHECK (make_vector (t.complete (prefix)) == expected);
+
+      std::vector<Completion<std::uint64_t>> result;
+
+      for (const auto &c : t.complete (prefix, context))
+      {
+	result.push_back (c);
+      }
+
+      BOOST_CHECK (result == expected);
+
+      /*
+       * Cursors taken while serving precomputed completions
+       */
+      for (const size_t page_size : {1u, 5u, 7u})
+      {
+	result.clear ();
+	auto page = t.complete (prefix);
+
+	while (!page.empty ())
+	{
+	  auto it = page.begin ();
+
+	  for (size_t j = 0; (j < page_size) && (it != page.end ()); ++j)
+	  {
+	    result.push_back (*it++);
+	  }
+
+	  page = t.resume (it.cursor ());
+	}
+
+	BOOST_CHECK (result == expected);
+      }
+    }
+  };
+
+  check (trie);
+
+  TemporaryFile tmp_file;
+  trie.write (tmp_file.get ());
+  check (OrderedTrie<std::uint64_t>::read (tmp_file.get ()));
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_bounded_completion)
+{
+  using Trie = OrderedTrie<std::uint64_t>;
+
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 29);
+
+  const auto trie = make_ordered_trie (suggestions);
+  Trie::QueryContext context;
+
+  for (const auto &prefix : {"", "0", "01", "1101", "2"})
+  {
+    const auto expected = make_vector (trie.complete (prefix));
+
+    /*
+     * Minimum score
+     */
+    for (const std::uint64_t min_score : {0u, 20u, 50u, 99u, 1000u})
+    {
+      Trie::CompleteOptions options;
+      options.min_score = min_score;
+
+      auto filtered = expected;
+
+      filtered.erase (
+	std::find_if (filtered.begin (), filtered.end (),
+		      [&] (const auto &c) {return c.score () < min_score;}),
+	filtered.end ());
+
+      const auto range = trie.complete (prefix, options);
+      BOOST_CHECK (make_vector (range) == filtered);
+
+      const std::string p {prefix};
+      BOOST_CHECK (make_vector (trie.complete (p.begin (), p.end (), options)) ==
+		   filtered);
+
+      std::vector<Completion<std::uint64_t>> result;
+
+      for (const auto &c : trie.complete (prefix, options, context))
+      {
+	result.push_back (c);
+      }
+
+      BOOST_CHECK (result == filtered);
+      BOOST_CHECK (!context.truncated ());
+
+      result.clear ();
+
+      for (const auto &c : trie.complete (p.begin (), p.end (), options, context))
+      {
+	result.push_back (c);
+      }
+
+      BOOST_CHECK (result == filtered);
+    }
+
+    /*
+     * Expansions budget: results are a prefix of the complete
+     * enumeration, which the cursor allows to continue.
+     */
+    for (const size_t budget : {0u, 1u, 10u, 100u, 100000u})
+    {
+      Trie::CompleteOptions options;
+      options.max_expansions = budget;
+
+      std::vector<Completion<std::uint64_t>> result;
+      auto range = trie.complete (prefix, options);
+      auto it = range.begin ();
+
+      for (; it != range.end (); ++it)
+      {
+	result.push_back (*it);
+      }
+
+      BOOST_CHECK (std::equal (result.begin (), result.end (),
+			       expected.begin ()));
+
+      BOOST_CHECK_EQUAL (it.truncated (),
+			 result.size () < expected.size ());
+
+      for (const auto &c : trie.resume (it.cursor ()))
+      {
+	result.push_back (c);
+      }
+
+      BOOST_CHECK (result == expected);
+    }
+
+    /*
+     * Expired deadline
+     */
+    Trie::CompleteOptions options;
+    options.deadline = std::chrono::steady_clock::now ();
+
+    const auto range = trie.complete (prefix, options, context);
+    BOOST_CHECK (range.empty ());
+    BOOST_CHECK_EQUAL (context.truncated (), !expected.empty ());
+  }
+
+  /*
+   * Minimum score of a trie ranking lower scores first, as
+   * built and as read with its comparer
+   */
+  const auto ascending = make_ordered_trie (suggestions, std::less<> {});
+
+  TemporaryFile tmp_file;
+  ascending.write (tmp_file.get ());
+
+  for (const auto &t : {ascending,
+			Trie::read (tmp_file.get (), std::less<> {})})
+  {
+    Trie::CompleteOptions options;
+    options.min_score = 50;
+
+    auto expected = make_vector (ascending.complete ("0"));
+
+    expected.erase (
+      std::find_if (expected.begin (), expected.end (),
+		    [] (const auto &c) {return c.score () > 50;}),
+      expected.end ());
+
+    BOOST_CHECK (!expected.empty ());
+    BOOST_CHECK (make_vector (t.complete ("0", options)) == expected);
+  }
+
+  BOOST_CHECK_THROW (Trie::read (tmp_file.get (), std::greater<> {}),
+		     std::invalid_argument);
+
+  Trie::CompleteOptions options;
+  options.min_score = 50;
+
+  const auto unbounded = Trie::read (tmp_file.get ());
+
+  BOOST_CHECK (make_vector (unbounded.complete ("0")) ==
+	       make_vector (ascending.complete ("0")));
+  BOOST_CHECK_THROW (unbounded.complete ("0", options), std::logic_error);
+
+  const auto copy = unbounded;
+  BOOST_CHECK_THROW (copy.complete ("0", options), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_user_serialised_scores)
+{
+  using Trie = OrderedTrie<long long>;
+
+  const auto suggestions =
+    make_two_digits_suggestions<long long> (10, 1000, 83);
+
+  /*
+   * Scores take less than sizeof (long long) bytes: check the
+   * completions bounded by score, where @p after ranks a score
+   * after another as the comparer of the trie does.
+   */
+  const auto check = [] (const Trie &t, const auto &after)
+  {
+    for (const long long min_score : {0, 20, 50, 99, 1000})
+    {
+      Trie::CompleteOptions options;
+      options.min_score = min_score;
+
+      for (const std::string prefix : {"", "0", "01", "1"})
+      {
+	auto expected = make_vector (t.complete (prefix));
+
+	expected.erase (
+	  std::find_if (expected.begin (), expected.end (),
+			[&] (const auto &c) {return after (c.score (), min_score);}),
+	  expected.end ());
+
+	BOOST_CHECK (make_vector (t.complete (prefix, options)) == expected);
+      }
+    }
+  };
+
+  const auto descending = make_ordered_trie (suggestions);
+  const auto ascending = make_ordered_trie (suggestions, std::less<> {});
+
+  TemporaryFile descending_file;
+  TemporaryFile ascending_file;
+  descending.write (descending_file.get ());
+  ascending.write (ascending_file.get ());
+
+  check (descending, std::less<> {});
+  check (Trie::read (descending_file.get ()), std::less<> {});
+  check (ascending, std::greater<> {});
+  check (Trie::read (ascending_file.get (), std::less<> {}), std::greater<> {});
+
+  BOOST_CHECK_NO_THROW (Trie::read (descending_file.get (), std::greater<> {}));
+  BOOST_CHECK_THROW (Trie::read (ascending_file.get (), std::greater<> {}),
+		     std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_complete_any)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 37);
+
+  const auto trie = make_ordered_trie (suggestions);
+  OrderedTrie<std::uint64_t>::QueryContext context;
+
+  const std::vector<std::vector<std::string>> queries =
+  {
+    {},
+    {"0"},
+    {"2", "3"},
+    {"01", "1101", "11"},
+    {"10", "10", "1001"},
+    {"0", "10", "110", "111", ""},
+    {"0001", "0010", "0100", "1000"}
+  };
+
+  const auto by_score = [] (const auto &x, const auto &y)
+  {
+    return y.second < x.second;
+  };
+
+  for (const auto &prefixes : queries)
+  {
+    std::set<Completion<std::uint64_t>> expected_set;
+
+    for (const auto &prefix : prefixes)
+    {
+      for (const auto &c : trie.complete (prefix))
+      {
+	expected_set.insert (c);
+      }
+    }
+
+    const std::vector<Completion<std::uint64_t>> expected
+    {
+      expected_set.begin (),
+      expected_set.end ()
+    };
+
+    auto result = make_vector (trie.complete_any (prefixes));
+    BOOST_CHECK (std::is_sorted (result.begin (), result.end (), by_score));
+    std::sort (result.begin (), result.end ());
+    BOOST_CHECK (result == expected);
+
+    result.clear ();
+
+    for (const auto &c : trie.complete_any (prefixes, context))
+    {
+      result.push_back (c);
+    }
+
+    BOOST_CHECK (std::is_sorted (result.begin (), result.end (), by_score));
+    std::sort (result.begin (), result.end ());
+    BOOST_CHECK (result == expected);
+  }
+
+  BOOST_CHECK (make_vector (trie.complete_any ({"0", "1"})) ==
+	       make_vector (trie.complete ("")));
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_category_masks)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 41);
+
+  std::vector<std::uint64_t> masks;
+  std::unordered_map<std::string, std::uint64_t> mask_of;
+
+  for (size_t j = 0; j < suggestions.size (); ++j)
+  {
+    masks.push_back ((j % 7) ? (1u << (j % 5)) : 0u);
+    mask_of[suggestions[j].first] = masks.back ();
+  }
+
+  const std::vector<std::string> prefixes =
+  {
+    "", "0", "1", "01", "110", "2", suggestions[3].first
+  };
+
+  const std::vector<std::uint64_t> filters = {1, 2 | 8, 16, 0, ~0ull};
+
+  const auto check = [&] (const OrderedTrie<std::uint64_t> &trie)
+  {
+    OrderedTrie<std::uint64_t>::QueryContext context;
+
+    for (const auto &prefix : prefixes)
+    {
+      for (const auto filter : filters)
+      {
+	std::vector<Completion<std::uint64_t>> expected;
+
+	for (const auto &c : trie.complete (prefix))
+	{
+	  if (mask_of.at (c.first) & filter)
+	  {
+	    expected.push_back (c);
+	  }
+	}
+
+	BOOST_CHECK (make_vector (trie.complete_filtered (prefix, filter)) == expected);
+
+	std::vector<Completion<std::uint64_t>> result;
+
+	for (const auto &c : trie.complete_filtered (prefix, filter, context))
+	{
+	  result.push_back (c);
+	}
+
+	BOOST_CHECK (result == expected);
+
+	/* Filtered cursors resume filtered */
+	if (expected.size () > 2)
+	{
+	  auto it = trie.complete_filtered (prefix, filter).begin ();
+	  ++it;
+	  ++it;
+
+	  const auto rest = make_vector (trie.resume (it.cursor ()));
+
+	  BOOST_CHECK (
+	    std::equal (rest.begin (), rest.end (),
+			expected.begin () + 2, expected.end ()));
+	}
+      }
+    }
+  };
+
+  for (const auto leaf_counts : {false, true})
+  {
+    for (const auto score_ranges : {false, true})
+    {
+      BuildOptions options;
+      options.leaf_counts = leaf_counts;
+      options.score_ranges = score_ranges;
+      options.category_masks = masks;
+
+      const auto trie = make_ordered_trie (
+	suggestions, std::greater<> {}, options);
+
+      check (trie);
+      BOOST_CHECK (make_vector (trie) ==
+		   make_vector (make_ordered_trie (suggestions)));
+      BOOST_CHECK_EQUAL (trie.count_completions ("0"),
+			 make_vector (trie.complete ("0")).size ());
+
+      TemporaryFile tmp_file;
+      trie.write (tmp_file.get ());
+      check (OrderedTrie<std::uint64_t>::read (tmp_file.get ()));
+    }
+  }
+
+  BuildOptions options;
+  options.category_masks = {1};
+
+  BOOST_CHECK_THROW (make_ordered_trie (suggestions, std::greater<> {}, options),
+		     std::length_error);
+
+  BOOST_CHECK_THROW (make_ordered_trie (suggestions).complete_filtered ("0", 1u),
+		     std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_lexicographic)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 43);
+
+  const auto trie = make_ordered_trie (suggestions);
+
+  BOOST_CHECK (make_vector (trie.lexicographic ()) == suggestions);
+
+  std::set<std::string> keys {"", "2", "~", "0000000000000"};
+
+  for (const auto &s : suggestions)
+  {
+    for (size_t j = 0; j <= s.first.size (); ++j)
+    {
+      keys.insert (s.first.substr (0, j));
+      keys.insert (s.first.substr (0, j) + '0');
+      keys.insert (s.first.substr (0, j) + '/');
+    }
+  }
+
+  const auto by_string = [] (const auto &x, const std::string &key)
+  {
+    return x.first < key;
+  };
+
+  for (const auto &key : keys)
+  {
+    const auto lower =
+      std::lower_bound (suggestions.begin (), suggestions.end (),
+			key, by_string);
+
+    const auto upper =
+      std::upper_bound (suggestions.begin (), suggestions.end (), key,
+			[] (const std::string &key, const auto &x)
+			{
+			  return key < x.first;
+			});
+
+    const auto result = make_vector (
+      boost::make_iterator_range (trie.lower_bound (key),
+				  trie.lexicographic ().end ()));
+
+    BOOST_CHECK (std::equal (result.begin (), result.end (),
+			     lower, suggestions.end ()));
+
+    BOOST_CHECK_EQUAL (
+      make_vector (boost::make_iterator_range (trie.lower_bound (key),
+					       trie.upper_bound (key))).size (),
+      upper - lower);
+  }
+
+  const auto range = make_vector (
+    boost::make_iterator_range (trie.lower_bound ("0101"),
+				trie.lower_bound ("0110")));
+
+  BOOST_CHECK (!range.empty ());
+
+  for (const auto &c : range)
+  {
+    BOOST_CHECK_EQUAL (c.first.substr (0, 4), "0101");
+  }
+
+  const OrderedTrie<std::uint64_t> small {{"", 1}, {"a", 3}, {"ab", 2}};
+
+  BOOST_CHECK (make_vector (small.lexicographic ()) ==
+	       (std::vector<Completion<std::uint64_t>> {{"", 1}, {"a", 3}, {"ab", 2}}));
+
+  BOOST_CHECK ((*small.upper_bound ("")).first == "a");
+  BOOST_CHECK (small.upper_bound ("ab") == small.lexicographic ().end ());
+
+  const OrderedTrie<std::uint64_t> empty_trie;
+  BOOST_CHECK (empty_trie.lexicographic ().empty ());
+  BOOST_CHECK (empty_trie.lower_bound ("a") == empty_trie.lexicographic ().end ());
+}
+
+/*
+ * Minimum edit distance between @p query and any prefix of @p s
+ */
+size_t prefix_edit_distance (const std::string &query,
+			     const std::string &s)
+{
+  std::vector<size_t> row (query.size () + 1);
+  std::iota (row.begin (), row.end (), 0u);
+  auto result = row.back ();
+
+  for (const auto c : s)
+  {
+    auto diagonal = row[0]++;
+
+    for (size_t i = 1; i < row.size (); ++i)
+    {
+      const auto above = row[i];
+      row[i] = std::min ({above + 1, row[i - 1] + 1,
+			  diagonal + (query[i - 1] != c)});
+      diagonal = above;
+    }
+
+    result = std::min (result, row.back ());
+  }
+
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_complete_fuzzy)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 47);
+
+  const auto trie = make_ordered_trie (suggestions);
+  OrderedTrie<std::uint64_t>::QueryContext context;
+
+  const auto by_score = [] (const auto &x, const auto &y)
+  {
+    return y.second < x.second;
+  };
+
+  for (const std::string query : {"", "0", "2", "0120", "11011", "1x01", "00000000"})
+  {
+    for (size_t max_edits = 0; max_edits < 4; ++max_edits)
+    {
+      std::vector<Completion<std::uint64_t>> expected;
+
+      for (const auto &s : suggestions)
+      {
+	if (prefix_edit_distance (query, s.first) <= max_edits)
+	{
+	  expected.push_back (s);
+	}
+      }
+
+      auto result = make_vector (trie.complete_fuzzy (query, max_edits));
+      BOOST_CHECK (std::is_sorted (result.begin (), result.end (), by_score));
+      std::sort (result.begin (), result.end ());
+      BOOST_CHECK (result == expected);
+
+      result.clear ();
+
+      for (const auto &c : trie.complete_fuzzy (query, max_edits, context))
+      {
+	result.push_back (c);
+      }
+
+      std::sort (result.begin (), result.end ());
+      BOOST_CHECK (result == expected);
+    }
+  }
+
+  BOOST_CHECK (make_vector (trie.complete_fuzzy ("0110", 0)) ==
+	       make_vector (trie.complete ("0110")));
+
+  BOOST_CHECK (make_vector (OrderedTrie<std::uint64_t> {}.complete_fuzzy ("a", 2)).empty ());
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_folded_index)
+{
+  std::vector<Completion<std::uint64_t>> suggestions =
+  {
+    {"APPLY", 7}, {"Apple", 3}, {"Apple Pie With Whipped Cream", 9},
+    {"Bandana", 2}, {"apple", 5}, {"apple pie with whipped cream", 1},
+    {"banana", 8}, {"\xc3\xb1u", 4}, {"\xc3\x91U", 6}
+  };
+
+  std::sort (suggestions.begin (), suggestions.end ());
+
+  const auto fold = [] (std::string s)
+  {
+    detail::fold_ascii_case (s);
+    return s;
+  };
+
+  BOOST_CHECK_EQUAL (fold ("Apple Pie With Whipped Cream \xc3\x91U"),
+		     "apple pie with whipped cream \xc3\x91u");
+
+  BuildOptions options;
+  options.folded_index = true;
+
+  const auto check = [&] (const OrderedTrie<std::uint64_t> &trie)
+  {
+    for (const std::string prefix :
+	 {"", "a", "APP", "apple ", "Apple pie with whipped", "b", "BANA",
+	  "\xc3\xb1", "\xc3\x91U", "c", "applesauce"})
+    {
+      std::vector<Completion<std::uint64_t>> expected;
+
+      for (const auto &s : suggestions)
+      {
+	if (fold (s.first).compare (0, prefix.size (), fold (prefix)) == 0)
+	{
+	  expected.push_back (s);
+	}
+      }
+
+      std::sort (expected.begin (), expected.end (),
+		 [] (const auto &x, const auto &y)
+		 {
+		   return y.second < x.second;
+		 });
+
+      BOOST_CHECK (make_vector (trie.complete_folded (prefix)) == expected);
+    }
+  };
+
+  const auto trie = make_ordered_trie (suggestions, std::greater<> {}, options);
+  check (trie);
+
+  BOOST_CHECK (make_vector (trie) == make_vector (make_ordered_trie (suggestions)));
+  BOOST_CHECK_EQUAL (make_vector (trie.complete ("\xc3\xb1")).size (), 1u);
+
+  TemporaryFile tmp_file;
+  trie.write (tmp_file.get ());
+  check (OrderedTrie<std::uint64_t>::read (tmp_file.get ()));
+
+  BOOST_CHECK_THROW (make_ordered_trie (suggestions).complete_folded ("a"),
+		     std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_word_start_index)
+{
+  std::vector<Completion<std::uint64_t>> suggestions =
+  {
+    {"New York City", 9}, {"York", 3}, {"new  york new york", 5},
+    {"Yorkshire pudding", 7}, {"New Jersey", 8}, {"jersey york", 1},
+    {" lead space", 2}, {"San\tJose", 6}, {"Stoke-on-Trent, UK", 4}
+  };
+
+  std::sort (suggestions.begin (), suggestions.end ());
+
+  BuildOptions options;
+  options.word_start_index = true;
+  options.folded_index = true;
+
+  const auto check = [&] (const OrderedTrie<std::uint64_t> &trie)
+  {
+    const auto strings = [] (const auto &range)
+    {
+      std::vector<std::string> result;
+
+      for (const auto &c : range)
+      {
+	result.push_back (c.first);
+      }
+
+      return result;
+    };
+
+    BOOST_CHECK (strings (trie.complete_infix ("york")) ==
+		 (std::vector<std::string>
+		  {"New York City", "Yorkshire pudding",
+		   "new  york new york", "York", "jersey york"}));
+
+    BOOST_CHECK (strings (trie.complete_infix ("NEW Y")) ==
+		 (std::vector<std::string>
+		  {"New York City", "new  york new york"}));
+
+    BOOST_CHECK (strings (trie.complete_infix ("jose")) ==
+		 (std::vector<std::string> {"San\tJose"}));
+
+    BOOST_CHECK (strings (trie.complete_infix ("trent")) ==
+		 (std::vector<std::string> {"Stoke-on-Trent, UK"}));
+
+    BOOST_CHECK (strings (trie.complete_infix ("on-t")) ==
+		 (std::vector<std::string> {"Stoke-on-Trent, UK"}));
+
+    BOOST_CHECK (strings (trie.complete_infix ("uk")) ==
+		 (std::vector<std::string> {"Stoke-on-Trent, UK"}));
+
+    BOOST_CHECK (strings (trie.complete_infix ("ead")).empty ());
+    BOOST_CHECK (strings (trie.complete_infix (",")).empty ());
+    BOOST_CHECK (strings (trie.complete_infix ("lead")) ==
+		 (std::vector<std::string> {" lead space"}));
+
+    BOOST_CHECK_EQUAL (strings (trie.complete_infix ("")).size (),
+		       suggestions.size ());
+
+    BOOST_CHECK (strings (trie.complete_folded ("new")) ==
+		 (std::vector<std::string>
+		  {"New York City", "New Jersey", "new  york new york"}));
+  };
+
+  const auto trie = make_ordered_trie (suggestions, std::greater<> {}, options);
+  check (trie);
+
+  TemporaryFile tmp_file;
+  trie.write (tmp_file.get ());
+  check (OrderedTrie<std::uint64_t>::read (tmp_file.get ()));
+
+  BOOST_CHECK_THROW (make_ordered_trie (suggestions).complete_infix ("york"),
+		     std::logic_error);
+
+  /*
+   * Suggestions repeating their words are returned once, by
+   * decreasing score
+   */
+  std::mt19937_64 rng {59};
+  std::map<std::string, std::uint64_t> random;
+
+  while (random.size () < 500)
+  {
+    std::string s;
+
+    for (auto n = rng () % 6; n; --n)
+    {
+      s.push_back ("ab -"[rng () % 4]);
+    }
+
+    random.emplace (s, rng () % 50);
+  }
+
+  std::vector<Completion<std::uint64_t>> random_suggestions;
+
+  for (const auto &r : random)
+  {
+    random_suggestions.emplace_back (r.first, r.second);
+  }
+
+  const auto random_trie = make_ordered_trie (
+    random_suggestions, std::greater<> {}, options);
+
+  for (const std::string query : {"", "a", "b", "ab", "ba", "aa"})
+  {
+    std::set<std::string> expected;
+
+    for (const auto &r : random)
+    {
+      detail::for_each_word_start (r.first, [&] (const std::size_t j)
+      {
+	if (r.first.compare (j, query.size (), query) == 0)
+	{
+	  expected.insert (r.first);
+	}
+      });
+    }
+
+    std::set<std::string> result;
+    std::uint64_t previous = std::numeric_limits<std::uint64_t>::max ();
+
+    for (const auto &c : random_trie.complete_infix (query))
+    {
+      BOOST_CHECK (result.insert (c.first).second);
+      BOOST_CHECK_LE (c.second, previous);
+      previous = c.second;
+    }
+
+    BOOST_CHECK (result == expected);
+  }
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_suffix_index)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (4, 31, 23);
+
+  BuildOptions options;
+  options.suffix_index = true;
+
+  const auto check = [&] (const OrderedTrie<std::uint64_t> &trie)
+  {
+    for (const std::string suffix : {"", "7", "07", "123", "9999", "x"})
+    {
+      std::vector<Completion<std::uint64_t>> expected;
+
+      for (const auto &s : suggestions)
+      {
+	if ((s.first.size () >= suffix.size ()) &&
+	    std::equal (suffix.rbegin (), suffix.rend (), s.first.rbegin ()))
+	{
+	  expected.push_back (s);
+	}
+      }
+
+      std::stable_sort (expected.begin (), expected.end (),
+			[] (const auto &lhs, const auto &rhs)
+			{
+			  return lhs.second > rhs.second;
+			});
+
+      std::vector<Completion<std::uint64_t>> actual;
+
+      for (const auto &c : trie.complete_suffix (suffix))
+      {
+	actual.emplace_back (c.first, c.score ());
+      }
+
+      BOOST_REQUIRE_EQUAL (actual.size (), expected.size ());
+
+      for (std::size_t j = 0; j < actual.size (); ++j)
+      {
+	BOOST_CHECK_EQUAL (actual[j].second, expected[j].second);
+	BOOST_CHECK (std::equal (suffix.rbegin (), suffix.rend (),
+				 actual[j].first.rbegin ()));
+      }
+
+      std::sort (actual.begin (), actual.end ());
+      std::sort (expected.begin (), expected.end ());
+      BOOST_CHECK (actual == expected);
+    }
+  };
+
+  const auto trie = make_ordered_trie (suggestions, std::greater<> {}, options);
+  check (trie);
+
+  TemporaryFile tmp_file;
+  trie.write (tmp_file.get ());
+  check (OrderedTrie<std::uint64_t>::read (tmp_file.get ()));
+
+  BOOST_CHECK_THROW (make_ordered_trie (suggestions).complete_suffix ("7"),
+		     std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_complete_pattern)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1000, 29);
+
+  const auto trie = make_ordered_trie (suggestions);
+  OrderedTrie<std::uint64_t>::QueryContext context;
+
+  const auto by_score = [] (const auto &x, const auto &y)
+  {
+    return y.second < x.second;
+  };
+
+  const std::vector<std::pair<std::string, std::string>> patterns =
+  {
+    {"*", ".*"}, {"", ""}, {"0", "0"}, {"01*", "01.*"}, {"?1?", ".1."},
+    {"*11", ".*11"}, {"1*0*1", "1.*0.*1"}, {"[!0]0**1?", "[^0]0.*1."},
+    {"[0-1][1]0*", "[0-1][1]0.*"}, {"\\1*", "1.*"}, {"2*", "2.*"},
+    {"??????????*", "...........*"}, {"[]0]1", "[\\]0]1"}
+  };
+
+  for (const auto &p : patterns)
+  {
+    const std::regex regex {p.second};
+    std::vector<Completion<std::uint64_t>> expected;
+
+    for (const auto &s : suggestions)
+    {
+      if (std::regex_match (s.first, regex))
+      {
+	expected.push_back (s);
+      }
+    }
+
+    auto result = make_vector (trie.complete_pattern (p.first));
+    BOOST_CHECK (std::is_sorted (result.begin (), result.end (), by_score));
+    std::sort (result.begin (), result.end ());
+    BOOST_CHECK (result == expected);
+
+    result.clear ();
+
+    for (const auto &c : trie.complete_pattern (p.first, context))
+    {
+      result.push_back (c);
+    }
+
+    std::sort (result.begin (), result.end ());
+    BOOST_CHECK (result == expected);
+  }
+
+  BOOST_CHECK (make_vector (trie.complete_pattern ("01*")) ==
+	       make_vector (trie.complete ("01")));
+
+  BOOST_CHECK_THROW (trie.complete_pattern ("[01"), std::invalid_argument);
+  BOOST_CHECK_THROW (trie.complete_pattern ("01\\"), std::invalid_argument);
+  BOOST_CHECK_THROW (trie.complete_pattern (std::string (64, '?')),
+		     std::invalid_argument);
+
+  BOOST_CHECK (make_vector (OrderedTrie<std::uint64_t> {}.complete_pattern ("*")).empty ());
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_batch)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1500, 71);
+
+  BuildOptions options;
+  options.top_k = 4;
+  options.top_k_threshold = 16;
+
+  const auto plain = make_ordered_trie (suggestions);
+  const auto top_k = make_ordered_trie (suggestions, std::greater<> {}, options);
+
+  std::mt19937_64 rng {5};
+  std::uniform_int_distribution<size_t> pick {0, suggestions.size () - 1};
+  std::uniform_int_distribution<size_t> cut {0, 11};
+
+  std::vector<std::string> queries {"", "2", "0x", "10101010101"};
+
+  for (size_t j = 0; j < 500; ++j)
+  {
+    const auto &s = suggestions[pick (rng)].first;
+    queries.push_back (s.substr (0, cut (rng)));
+    queries.push_back (s + "1");
+  }
+
+  for (const auto *trie : {&plain, &top_k})
+  {
+    const auto counts = trie->count_batch (queries);
+    const auto scores = trie->score_batch (queries);
+    const auto completions = trie->complete_batch (queries, 5);
+
+    BOOST_REQUIRE_EQUAL (counts.size (), queries.size ());
+    BOOST_REQUIRE_EQUAL (scores.size (), queries.size ());
+    BOOST_REQUIRE_EQUAL (completions.size (), queries.size ());
+
+    for (size_t j = 0; j < queries.size (); ++j)
+    {
+      BOOST_CHECK_EQUAL (counts[j], trie->count (queries[j]));
+
+      std::uint64_t score = 0;
+      BOOST_CHECK_EQUAL (static_cast<bool> (scores[j]),
+			 trie->score (score, queries[j]));
+      BOOST_CHECK (!scores[j] || (*scores[j] == score));
+
+      auto expected = make_vector (trie->complete (queries[j]));
+      expected.resize (std::min<size_t> (expected.size (), 5));
+      BOOST_CHECK (completions[j] == expected);
+    }
+  }
+
+  const std::list<std::string> empty_queries;
+  BOOST_CHECK (plain.count_batch (empty_queries).empty ());
+
+  const OrderedTrie<std::uint64_t> empty_trie;
+  BOOST_CHECK (empty_trie.count_batch (queries) ==
+	       std::vector<size_t> (queries.size (), 0));
+  BOOST_CHECK (empty_trie.complete_batch (queries, 3) ==
+	       std::vector<std::vector<Completion<std::uint64_t>>> (queries.size ()));
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_completion_session)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1500, 37);
+
+  BuildOptions options;
+  options.top_k = 3;
+  options.top_k_threshold = 10;
+
+  for (const auto &trie : {make_ordered_trie (suggestions),
+			   make_ordered_trie (suggestions, std::greater<> {}, options)})
+  {
+    OrderedTrie<std::uint64_t>::CompletionSession session {trie};
+
+    const auto check = [&] (const std::size_t k)
+    {
+      const auto &prefix = session.prefix ();
+      const auto expected = make_vector (trie.complete (prefix));
+
+      BOOST_CHECK_EQUAL (session.matched (), !expected.empty ());
+      BOOST_CHECK (make_vector (session.complete ()) == expected);
+
+      const auto top = make_vector (session.top (k));
+      BOOST_CHECK (std::equal (top.begin (), top.end (), expected.begin (),
+			       expected.begin () + std::min (k, expected.size ())));
+      BOOST_CHECK_EQUAL (top.size (), std::min (k, expected.size ()));
+    };
+
+    std::mt19937_64 rng {41};
+
+    for (size_t j = 0; j < 300; ++j)
+    {
+      switch (rng () % 4)
+      {
+      case 0:
+	if (!session.prefix ().empty ())
+	{
+	  session.pop_back ();
+	  break;
+	}
+	// Fall through
+      case 1:
+      case 2:
+	session.push_back ("012"[rng () % 3]);
+	break;
+      default:
+	session.assign (suggestions[rng () % suggestions.size ()].first.substr (
+	  0, rng () % 8));
+      }
+
+      check (1 + rng () % 6);
+    }
+
+    session.assign ("");
+    check (4);
+    BOOST_CHECK_THROW (session.pop_back (), std::logic_error);
+  }
+
+  const OrderedTrie<std::uint64_t> empty_trie;
+  OrderedTrie<std::uint64_t>::CompletionSession session {empty_trie};
+  BOOST_CHECK (!session.matched ());
+  session.push_back ('a');
+  BOOST_CHECK (make_vector (session.complete ()).empty ());
+  BOOST_CHECK (session.top (3).empty ());
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_sorted_lookups)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (12, 3000, 53);
+
+  const auto trie = make_ordered_trie (suggestions);
+
+  std::mt19937_64 rng {9};
+  std::vector<std::string> inputs {"", "", "2"};
+
+  for (size_t j = 0; j < 3000; ++j)
+  {
+    const auto &s = suggestions[rng () % suggestions.size ()].first;
+
+    inputs.push_back (s);
+    inputs.push_back (s.substr (0, rng () % (s.size () + 1)));
+    inputs.push_back (s + "01"[rng () % 2]);
+  }
+
+  const auto check = [&] (const std::vector<std::string> &keys)
+  {
+    std::vector<size_t> counts;
+    std::vector<boost::optional<std::uint64_t>> scores;
+
+    trie.count_sorted (keys, std::back_inserter (counts));
+    trie.score_sorted (keys, std::back_inserter (scores));
+
+    BOOST_REQUIRE_EQUAL (counts.size (), keys.size ());
+    BOOST_REQUIRE_EQUAL (scores.size (), keys.size ());
+
+    for (size_t j = 0; j < keys.size (); ++j)
+    {
+      std::uint64_t score = 0;
+      const auto found = trie.score (score, keys[j]);
+
+      BOOST_CHECK_EQUAL (counts[j], trie.count (keys[j]));
+      BOOST_CHECK_EQUAL (static_cast<bool> (scores[j]), found);
+      BOOST_CHECK (!found || (*scores[j] == score));
+    }
+  };
+
+  check (inputs);
+
+  std::sort (inputs.begin (), inputs.end ());
+  check (inputs);
+
+  std::vector<size_t> counts;
+  OrderedTrie<std::uint64_t> {}.count_sorted (inputs, std::back_inserter (counts));
+  BOOST_CHECK (counts == std::vector<size_t> (inputs.size (), 0));
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_parallel_complete)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (14, 4000, 59);
+
+  const auto trie = make_ordered_trie (suggestions);
+
+  std::mt19937_64 rng {21};
+  std::vector<std::string> prefixes;
+
+  for (size_t j = 0; j < 5000; ++j)
+  {
+    const auto &s = suggestions[rng () % suggestions.size ()].first;
+    prefixes.push_back (s.substr (0, rng () % (s.size () + 1)));
+
+    if (j % 7 == 0)
+    {
+      prefixes.back () += '2';
+    }
+  }
+
+  const auto expected = trie.complete_batch (prefixes, 5);
+
+  for (const size_t threads : {1, 4})
+  {
+    std::vector<std::vector<Completion<std::uint64_t>>> result (
+      prefixes.size ());
+    std::vector<size_t> calls (prefixes.size ());
+    std::vector<size_t> workers (threads);
+
+    trie.parallel_complete (
+      prefixes, 5,
+      [&] (const size_t worker, const size_t j, const auto &completions)
+      {
+	++workers.at (worker);
+	++calls[j];
+	result[j].assign (completions.begin (), completions.end ());
+      },
+      threads);
+
+    BOOST_CHECK (calls == std::vector<size_t> (prefixes.size (), 1));
+    BOOST_CHECK (result == expected);
+    BOOST_CHECK_EQUAL (
+      std::accumulate (workers.begin (), workers.end (), size_t {0}),
+      prefixes.size ());
+  }
+
+  BOOST_CHECK_THROW (
+    trie.parallel_complete (
+      prefixes, 5,
+      [] (size_t, const size_t j, const auto&)
+      {
+	if (j == 3000)
+	{
+	  throw std::runtime_error ("sink failure");
+	}
+      },
+      4),
+    std::runtime_error);
+
+  size_t calls = 0;
+  OrderedTrie<std::uint64_t> {}.parallel_complete (
+    prefixes, 5,
+    [&calls] (size_t, size_t, const auto &completions)
+    {
+      BOOST_CHECK (completions.empty ());
+      ++calls;
+    },
+    1);
+
+  BOOST_CHECK_EQUAL (calls, prefixes.size ());
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_parallel_export)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (12, 3000, 61);
+
+  const auto trie = make_ordered_trie (suggestions);
+  using Trie = std::decay_t<decltype (trie)>;
+
+  /*
+   * Suggestions tied by score may come in any order
+   */
+  const auto scores_of = [] (const auto &suggestions)
+  {
+    std::vector<std::uint64_t> result;
+
+    for (const auto &s : suggestions)
+    {
+      result.push_back (s.second);
+    }
+
+    return result;
+  };
+
+  const auto ranked = scores_of (
+    boost::make_iterator_range (trie.begin (), trie.end ()));
+
+  const auto concatenate = [] (const auto &partitions)
+  {
+    std::vector<Completion<std::uint64_t>> result;
+
+    for (const auto &p : partitions)
+    {
+      result.insert (result.end (), p.begin (), p.end ());
+    }
+
+    return result;
+  };
+
+  for (const size_t depth : {0, 1, 3, 20})
+  {
+    for (const size_t threads : {1, 3})
+    {
+      BOOST_CHECK (
+	concatenate (trie.parallel_export (
+	  Trie::EXPORT_LEXICOGRAPHIC, threads, depth)) == suggestions);
+
+      const auto merged =
+	trie.parallel_export (Trie::EXPORT_RANK, threads, depth);
+
+      BOOST_REQUIRE_EQUAL (merged.size (), 1u);
+      BOOST_CHECK (scores_of (merged.front ()) == ranked);
+
+      auto all = merged.front ();
+      std::sort (all.begin (), all.end ());
+      BOOST_CHECK (all == suggestions);
+
+      const auto partitions =
+	trie.parallel_export (Trie::EXPORT_PARTITION_RANK, threads, depth);
+
+      for (const auto &p : partitions)
+      {
+	const auto scores = scores_of (p);
+
+	BOOST_CHECK (std::is_sorted (scores.begin (), scores.end (),
+				     std::greater<> {}));
+      }
+
+      all = concatenate (partitions);
+      std::sort (all.begin (), all.end ());
+      BOOST_CHECK (all == suggestions);
+    }
+  }
+
+  BOOST_CHECK (Trie {}.parallel_export ().empty ());
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_prefix_cursor)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 1500, 67);
+
+  BuildOptions options;
+  options.top_k = 3;
+  options.top_k_threshold = 10;
+
+  for (const auto &trie : {make_ordered_trie (suggestions),
+			   make_ordered_trie (suggestions, std::greater<> {}, options)})
+  {
+    const auto check = [&] (const OrderedTrie<std::uint64_t>::PrefixCursor &cursor)
+    {
+      const auto &prefix = cursor.prefix ();
+      std::string expected_children;
+
+      for (const char c : {'0', '1'})
+      {
+	const auto next = prefix + c;
+	const auto it = std::lower_bound (
+	  suggestions.begin (), suggestions.end (), next,
+	  [] (const auto &s, const std::string &key)
+	  {
+	    return s.first < key;
+	  });
+
+	if ((it != suggestions.end ()) &&
+	    (it->first.compare (0, next.size (), next) == 0))
+	{
+	  expected_children.push_back (c);
+	}
+      }
+
+      BOOST_CHECK_EQUAL (cursor.children (), expected_children);
+      BOOST_CHECK_EQUAL (cursor.is_terminal (), trie.count (prefix) == 1);
+      BOOST_CHECK (make_vector (cursor.complete ()) ==
+		   make_vector (trie.complete (prefix)));
+
+      if (cursor.is_terminal ())
+      {
+	BOOST_CHECK_EQUAL (cursor.score (), trie.score (prefix));
+      }
+      else
+      {
+	BOOST_CHECK_THROW (cursor.score (), std::logic_error);
+      }
+    };
+
+    std::mt19937_64 rng {43};
+
+    for (size_t j = 0; j < 100; ++j)
+    {
+      const auto &target = suggestions[rng () % suggestions.size ()].first;
+      auto cursor = trie.prefix_cursor ();
+
+      check (cursor);
+
+      for (const auto c : target)
+      {
+	BOOST_CHECK (!cursor.advance ('2'));
+	BOOST_REQUIRE (cursor.advance (c));
+	check (cursor);
+      }
+
+      BOOST_CHECK (cursor.is_terminal ());
+
+      std::string input;
+
+      for (size_t n = rng () % 14; n; --n)
+      {
+	input.push_back ("01"[rng () % 2]);
+      }
+
+      BOOST_CHECK_EQUAL (trie.prefix_cursor (input).prefix ().size (),
+			 trie.mismatch (input));
+    }
+  }
+
+  const OrderedTrie<std::uint64_t> empty_trie;
+  auto cursor = empty_trie.prefix_cursor ("01");
+
+  BOOST_CHECK (cursor.prefix ().empty ());
+  BOOST_CHECK (cursor.children ().empty ());
+  BOOST_CHECK (!cursor.is_terminal ());
+  BOOST_CHECK (cursor.complete ().empty ());
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_filter)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (12, 3000, 71);
+
+  std::mt19937_64 rng {47};
+  std::vector<std::string> queries {""};
+
+  for (size_t j = 0; j < 3000; ++j)
+  {
+    const auto &s = suggestions[rng () % suggestions.size ()].first;
+    queries.push_back (s);
+    queries.push_back (s.substr (0, rng () % (s.size () + 1)));
+
+    std::string random;
+
+    for (size_t n = rng () % 15; n; --n)
+    {
+      random.push_back ("012"[rng () % 3]);
+    }
+
+    queries.push_back (random);
+  }
+
+  const auto plain = make_ordered_trie (suggestions);
+
+  /*
+   * No false negatives, and few false positives
+   */
+  const auto segment = detail::make_filter_segment (suggestions, 10, 4);
+  const detail::BloomFilter filter {segment.data (),
+				    segment.data () + segment.size ()};
+
+  size_t missing = 0;
+  size_t accepted = 0;
+
+  for (const auto &q : queries)
+  {
+    if (plain.count (q))
+    {
+      BOOST_CHECK (filter.may_contain (q.begin (), q.end ()));
+    }
+    else
+    {
+      ++missing;
+      accepted += filter.may_contain (q.begin (), q.end ());
+    }
+  }
+
+  BOOST_CHECK_LT (accepted * 20, missing);
+
+  BuildOptions options;
+  options.filter_bits_per_key = 10;
+  options.filter_prefix_length = 4;
+
+  TemporaryFile tmp_file;
+  const auto tmp_path = tmp_file.get ();
+
+  make_ordered_trie (suggestions, std::greater<> {}, options).write (tmp_path);
+
+  for (const auto &trie : {make_ordered_trie (suggestions, std::greater<> {}, options),
+			   OrderedTrie<std::uint64_t>::read (tmp_path)})
+  {
+    for (const auto &q : queries)
+    {
+      std::uint64_t expected = 0;
+      std::uint64_t score = 0;
+
+      BOOST_CHECK_EQUAL (trie.count (q), plain.count (q));
+      BOOST_CHECK_EQUAL (trie.score (score, q), plain.score (expected, q));
+      BOOST_CHECK_EQUAL (score, expected);
+      BOOST_CHECK (make_vector (trie.complete (q)) ==
+		   make_vector (plain.complete (q)));
+    }
+
+    for (size_t j = 0; j + 2 < queries.size (); j += 3)
+    {
+      const std::vector<std::string> prefixes {
+	queries[j], queries[j + 1], queries[j + 2]};
+
+      BOOST_CHECK (make_vector (trie.complete_any (prefixes)) ==
+		   make_vector (plain.complete_any (prefixes)));
+    }
+
+    BOOST_CHECK_THROW (trie.score ("2"), std::logic_error);
+  }
+}
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_read_earlier_releases)
+{
+  const auto suggestions =
+    make_two_digits_suggestions<std::uint64_t> (10, 500, 73);
+
+  BuildOptions options;
+  options.filter_bits_per_key = 10;
+  options.filter_prefix_length = 4;
+
+  TemporaryFile tmp_file;
+  const auto tmp_path = tmp_file.get ();
+
+  make_ordered_trie (suggestions, std::greater<> {}, options).write (tmp_path);
+
+  std::vector<std::uint8_t> bytes;
+
+  {
+    std::ifstream fin (tmp_path, std::ios_base::binary);
+    bytes.assign (std::istreambuf_iterator<char> {fin},
+		  std::istreambuf_iterator<char> {});
+  }
+
+  /*
+   * Header: type info line, endianness, release number, then
+   * 64 bit words (score table and trie segments, annotations
+   * since 1.1, top-k segment since 1.2, companions segment
+   * since 1.3, filter segment since 1.4)
+   */
+  const auto words = static_cast<std::size_t> (
+    std::find (bytes.begin (), bytes.end (), '\n') - bytes.begin ()) +
+    1 + 1 + 3 * sizeof (std::uint32_t);
+
+  const auto minor = words - 2 * sizeof (std::uint32_t);
+  const std::size_t extensions[] = {0, 1, 3, 5, 7};
+  const auto header_size = words + 11 * sizeof (std::uint64_t);
+
+  BOOST_REQUIRE_EQUAL (deserialise<std::uint32_t> (&bytes[minor]), 4u);
+
+  const auto patch = [] (std::vector<std::uint8_t> &out,
+			 const std::size_t         at,
+			 const auto                value)
+  {
+    std::vector<std::uint8_t> buffer;
+    serialise (buffer, value);
+    std::copy (buffer.begin (), buffer.end (), out.begin () + at);
+  };
+
+  const auto plain = make_ordered_trie (suggestions);
+
+  for (std::uint32_t release = 0; release < 4; ++release)
+  {
+    /*
+     * Rewrite the file with the shorter header of release
+     * 1.release, moving the segments accordingly: the filter
+     * segment is left as trailing bytes
+     */
+    const auto size = words + (4 + extensions[release]) * sizeof (std::uint64_t);
+    const auto shift = header_size - size;
+
+    std::vector<std::uint8_t> earlier (bytes.begin (), bytes.begin () + size);
+    earlier.insert (earlier.end (), bytes.begin () + header_size, bytes.end ());
+
+    patch (earlier, minor, release);
+
+    for (const std::size_t segment : {0u, 2u})
+    {
+      const auto at = words + segment * sizeof (std::uint64_t);
+      const auto offset = deserialise<std::uint64_t> (&earlier[at]);
+
+      if (offset)
+      {
+	patch (earlier, at, offset - shift);
+      }
+    }
+
+    {
+      std::ofstream fout (tmp_path, std::ios_base::binary |
+			  std::ios_base::trunc);
+      fout.write (reinterpret_cast<const char *> (earlier.data ()),
+		  earlier.size ());
+    }
+
+    const auto trie = OrderedTrie<std::uint64_t>::read (tmp_path);
+
+    BOOST_CHECK (make_vector (trie.complete ("")) ==
+		 make_vector (plain.complete ("")));
+
+    for (const auto &suggestion : suggestions)
+    {
+      BOOST_CHECK_EQUAL (trie.count (suggestion.first), 1u);
+      BOOST_CHECK_EQUAL (trie.count (suggestion.first + "2"), 0u);
+    }
+  }
+}
+
 int main (int argc, char **argv)
 {
   return boost::unit_test::unit_test_main(
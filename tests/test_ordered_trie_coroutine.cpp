@@ -0,0 +1,121 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_ordered_trie_coroutine
+#define BOOST_TEST_NO_MAIN
+
+#ifndef BOOST_SYSTEM_NO_DEPRECATED
+#define BOOST_SYSTEM_NO_DEPRECATED 1
+#endif
+
+#include "test_utils.h"
+
+#include "ordered_trie.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace ordered_trie;
+using namespace ordered_trie::test_utils;
+
+static_assert (ORDERED_TRIE_HAS_COROUTINES,
+	       "Coroutines tests require a C++20 compiler");
+
+BOOST_AUTO_TEST_CASE (test_ordered_trie_lookup_interleaved)
+{
+  using Trie = OrderedTrie<std::uint64_t>;
+
+  std::vector<std::pair<std::string, std::uint64_t>> suggestions;
+  std::mt19937_64 rng {17};
+
+  for (std::size_t j = 0; j < 3000; ++j)
+  {
+    std::string text (1 + rng () % 12, 'a');
+
+    for (auto &c : text)
+    {
+      c = static_cast<char> ('a' + rng () % 3);
+    }
+
+    suggestions.emplace_back (text, rng () % 100);
+  }
+
+  std::sort (suggestions.begin (), suggestions.end ());
+
+  suggestions.erase (
+    std::unique (suggestions.begin (), suggestions.end (),
+		 [] (const auto &lhs, const auto &rhs)
+		 {
+		   return lhs.first == rhs.first;
+		 }),
+    suggestions.end ());
+
+  BuildOptions options;
+  options.top_k = 3;
+  options.top_k_threshold = 8;
+
+  const auto trie =
+    make_ordered_trie (suggestions, std::greater<> {}, options);
+
+  std::vector<Trie::Lookup> lookups
+  {
+    {Trie::Lookup::SCORE, "", 0},
+    {Trie::Lookup::COMPLETE, "", 4},
+    {Trie::Lookup::COMPLETE, "d", 4},
+    {Trie::Lookup::SCORE, "abd", 0}
+  };
+
+  for (std::size_t j = 0; j < 2000; ++j)
+  {
+    const auto &s = suggestions[rng () % suggestions.size ()].first;
+
+    lookups.push_back ({Trie::Lookup::SCORE, s, 0});
+    lookups.push_back ({Trie::Lookup::SCORE, s + "b", 0});
+    lookups.push_back ({Trie::Lookup::COMPLETE, s.substr (0, rng () % 5),
+			rng () % 6});
+  }
+
+  const auto results = trie.lookup_interleaved (lookups);
+  BOOST_REQUIRE_EQUAL (results.size (), lookups.size ());
+
+  for (std::size_t j = 0; j < lookups.size (); ++j)
+  {
+    const auto &lookup = lookups[j];
+
+    if (lookup.kind == Trie::Lookup::SCORE)
+    {
+      std::uint64_t score = 0;
+      const auto found = trie.score (score, lookup.input);
+
+      BOOST_CHECK_EQUAL (static_cast<bool> (results[j].score), found);
+      BOOST_CHECK (!found || (*results[j].score == score));
+      BOOST_CHECK (results[j].completions.empty ());
+    }
+    else
+    {
+      auto expected = make_vector (trie.complete (lookup.input));
+      expected.resize (std::min (expected.size (), lookup.k));
+
+      BOOST_CHECK (!results[j].score);
+      BOOST_CHECK (results[j].completions == expected);
+    }
+  }
+
+  const Trie empty_trie;
+  const auto empty_results = empty_trie.lookup_interleaved (lookups);
+  BOOST_REQUIRE_EQUAL (empty_results.size (), lookups.size ());
+
+  for (const auto &r : empty_results)
+  {
+    BOOST_CHECK (!r.score && r.completions.empty ());
+  }
+}
+
+int main (int argc, char **argv)
+{
+  return boost::unit_test::unit_test_main(
+            &init_unit_test, argc, argv);
+}